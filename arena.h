@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "framebuffer.h"
+
+// Memoria temporal de un frame: allocate() solo avanza un puntero y reset() suelta todo junto.
+// Si un frame no cupo en un bloque, reset() deja uno solo con la capacidad de todos,
+// asi que en estado estable no se vuelve a llamar a new.
+class FrameArena {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+        // Memoria sin inicializar para `count` elementos; vale hasta el proximo reset()
+        template <typename T>
+        T* allocate(size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>);
+            static_assert(alignof(T) <= BUFFER_ALIGNMENT);
+            size_t bytes = count * sizeof(T);
+            size_t offset = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+            if (blocks.empty() || offset + bytes > blockSizes.back()) {
+                addBlock(bytes);
+                offset = 0;
+            }
+            used = offset + bytes;
+            T* items = reinterpret_cast<T*>(blocks.back().get() + offset);
+            std::uninitialized_default_construct_n(items, count);
+            return items;
+        }
+
+        void reset() {
+            if (blocks.size() > 1) {
+                size_t capacity = 0;
+                for (size_t size : blockSizes) {
+                    capacity += size;
+                }
+                blocks.clear();
+                blockSizes.clear();
+                addBlock(capacity);
+            }
+            used = 0;
+        }
+
+    private:
+        void addBlock(size_t bytes) {
+            size_t size = std::max(bytes, DEFAULT_BLOCK_SIZE);
+            blocks.push_back(allocateAligned<std::byte>(size));
+            blockSizes.push_back(size);
+            used = 0;
+        }
+
+        std::vector<AlignedArray<std::byte>> blocks;
+        std::vector<size_t> blockSizes;
+        size_t used = 0; // bytes usados del ultimo bloque
+};
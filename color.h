@@ -45,6 +45,11 @@ struct Color {
         );
     }
 
+    // Empaqueta en SDL_PIXELFORMAT_ARGB8888, el formato nativo del framebuffer
+    Uint32 toARGB() const {
+        return (Uint32(a) << 24) | (Uint32(r) << 16) | (Uint32(g) << 8) | Uint32(b);
+    }
+
     // Friend function to allow float * Color
     friend Color operator*(float factor, const Color& color);
 };
\ No newline at end of file
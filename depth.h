@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+enum DepthFormat {
+    DEPTH_FLOAT32,
+    DEPTH_FLOAT32_REVERSED, // near = 1, far = 0 desde la proyeccion, ver createProjectionMatrix()
+    DEPTH_UNORM24,
+    DEPTH_UNORM32,
+};
+
+DepthFormat depthFormat = DEPTH_FLOAT32;
+
+// Todos los formatos se guardan como una llave de 32 bits donde menor = mas cerca,
+// asi el depth test es una sola comparacion sin signo sin importar el formato
+constexpr uint32_t DEPTH_CLEAR = 0xFFFFFFFF;
+
+// Ordena cualquier float (negativos incluidos) como un entero sin signo
+uint32_t floatKey(float z) {
+    uint32_t bits;
+    std::memcpy(&bits, &z, sizeof(bits));
+    return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+}
+
+float keyFloat(uint32_t key) {
+    uint32_t bits = (key & 0x80000000) ? key & 0x7FFFFFFF : ~key;
+    float z;
+    std::memcpy(&z, &bits, sizeof(z));
+    return z;
+}
+
+uint32_t encodeDepth(float z) {
+    switch (depthFormat) {
+        case DEPTH_FLOAT32:
+            return floatKey(z);
+        case DEPTH_FLOAT32_REVERSED:
+            return ~floatKey(z);
+        case DEPTH_UNORM24:
+            return static_cast<uint32_t>(std::clamp(z, 0.0f, 1.0f) * 16777215.0f + 0.5f);
+        case DEPTH_UNORM32:
+            return static_cast<uint32_t>(std::clamp(static_cast<double>(z), 0.0, 1.0) * 4294967295.0 + 0.5);
+    }
+    return DEPTH_CLEAR;
+}
+
+float decodeDepth(uint32_t key) {
+    switch (depthFormat) {
+        case DEPTH_FLOAT32:
+            return keyFloat(key);
+        case DEPTH_FLOAT32_REVERSED:
+            return keyFloat(~key);
+        case DEPTH_UNORM24:
+            return static_cast<float>(key) / 16777215.0f;
+        case DEPTH_UNORM32:
+            return static_cast<float>(key / 4294967295.0);
+    }
+    return 1.0f;
+}
@@ -9,21 +9,60 @@ struct Vertex {
   glm::vec3 tex;
   glm::vec3 worldPos;
   glm::vec3 originalPos;
+  float invW; // 1 / w de clip space, para interpolar con correccion de perspectiva
+  glm::vec3 tangent;   // marco del normal map, ver meshVertex(); cero si el material no tiene
+  glm::vec3 bitangent;
 };
 
+// Campos opcionales de un fragmento. El rasterizador siempre calcula z, la normal e intensity
+// (la cobertura depende de intensity), pero solo guarda lo que se pide; cada shader declara
+// lo que lee en su ShaderTraits (shaders.h).
+enum Varying : uint8_t {
+  VARYING_WORLD_POS = 1 << 0,
+  VARYING_ORIGINAL_POS = 1 << 1,
+  VARYING_NORMAL = 1 << 2,
+  VARYING_TEX = 1 << 3, // uv y sus derivadas en pantalla, para elegir el mip
+  VARYING_TANGENT = 1 << 4, // tangent y bitangent, los ejes x e y del normal map
+};
+
+// Lo que necesita un texel del G-buffer
+constexpr uint8_t GBUFFER_VARYINGS = VARYING_ORIGINAL_POS | VARYING_NORMAL;
+
 struct Fragment {
   uint16_t x;      
   uint16_t y;      
-  double z;  // zbuffer
+  float z;  // zbuffer
   Color color; // r, g, b values for color
   float intensity;  // light intensity
   glm::vec3 worldPos;
   glm::vec3 originalPos;
   glm::vec3 normal;
+  glm::vec2 tex;   // uv de Vertex::tex
+  glm::vec2 texDx; // d(uv)/dx y d(uv)/dy en pantalla
+  glm::vec2 texDy;
+  glm::vec3 tangent;   // sin normalizar
+  glm::vec3 bitangent;
 };
 
-struct FragColor {
-  Color color;
-  double z; // instead of z buffer
+constexpr uint8_t GBUFFER_EMPTY = 0xFF;
+constexpr uint16_t NO_MODEL = 0xFFFF;
+
+// Lo minimo que necesita un shader para reconstruir su Fragment en la pasada diferida.
+// La profundidad se comparte con el depth buffer del RenderTarget.
+struct GBufferTexel {
+  glm::vec3 originalPos; // posicion en espacio del objeto
+  uint32_t normal;       // normal octaedrica, 2 x 16 bits
+  uint8_t material;      // shaderType del modelo, GBUFFER_EMPTY si no hay nada
+  uint16_t model;        // indice del modelo que cubre el pixel
 };
 
+// La uv y el marco tangente de un pixel del G-buffer, aparte para que el GBufferTexel no crezca:
+// solo se reserva si algun modelo del frame pide VARYING_TEX o VARYING_TANGENT, y solo la
+// escriben esos modelos.
+struct GBufferSurface {
+  glm::vec2 tex;
+  uint32_t texDx;     // d(uv)/dx y d(uv)/dy del triangle setup, 2 x half cada una: restar la uv
+  uint32_t texDy;     // de los vecinos cruzaria aristas y costuras y elegiria otro mip
+  uint32_t tangent;   // octaedricas como GBufferTexel::normal, solo con VARYING_TANGENT
+  uint32_t bitangent;
+};
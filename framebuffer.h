@@ -1,64 +1,206 @@
 #pragma once
-#include <array>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 #include "glm/glm.hpp"
-#include <limits>
-#include <mutex>
 #include "color.h"  // Include your Color class header
 #include "fragment.h"
+#include "depth.h"
 
-constexpr size_t SCREEN_WIDTH = 800;
-constexpr size_t SCREEN_HEIGHT = 600;
+// Los buffers se limpian por tiles: solo los tiles que se escribieron en el frame se limpian en el siguiente
+constexpr size_t TILE_SIZE = 32;
 
-FragColor blank{
-  Color{0, 0, 0},
-  std::numeric_limits<double>::max()
+// Pixeles ya en el formato de la textura (ARGB8888), fila 0 arriba
+constexpr Uint32 FRAMEBUFFER_FORMAT = SDL_PIXELFORMAT_ARGB8888;
+
+constexpr size_t BUFFER_ALIGNMENT = 64;
+
+Uint32 blank = Color{0, 0, 0}.toARGB();
+
+struct AlignedDelete {
+    void operator()(void* p) const {
+        ::operator delete[](p, std::align_val_t{BUFFER_ALIGNMENT});
+    }
+};
+
+template <typename T>
+using AlignedArray = std::unique_ptr<T[], AlignedDelete>;
+
+// Arreglo en el heap alineado a linea de cache; solo para tipos triviales, nadie llama a sus destructores
+template <typename T>
+AlignedArray<T> allocateAligned(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    T* items = static_cast<T*>(::operator new[](count * sizeof(T), std::align_val_t{BUFFER_ALIGNMENT}));
+    std::uninitialized_default_construct_n(items, count);
+    return AlignedArray<T>(items);
+}
+
+// Destino de render con resolucion de runtime. Cada uno es dueño de sus buffers,
+// asi pueden existir varios a la vez (ventana, render offline, thumbnails...)
+class RenderTarget {
+    public:
+        RenderTarget(size_t width, size_t height)
+            : width(width),
+              height(height),
+              capacity(width * height),
+              tilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+              tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+              color(allocateAligned<Uint32>(width * height)),
+              depth(allocateAligned<uint32_t>(width * height)),
+              colorDirty(tilesX * tilesY, 1),
+              depthDirty(tilesX * tilesY, 1) {}
+
+        size_t width;
+        size_t height;
+        size_t capacity; // pixeles reservados, puede ser mas que width * height
+        size_t tilesX;
+        size_t tilesY;
+
+        AlignedArray<Uint32> color;
+        // Depth vive aparte del color para que el depth test solo toque sus propias lineas de cache
+        AlignedArray<uint32_t> depth;
+        // Se reserva la primera vez que se usa el modo diferido, ver gbuffer.h
+        AlignedArray<GBufferTexel> gbuffer;
+        // Solo si algun modelo con textura llega al raster en modo diferido
+        AlignedArray<GBufferSurface> surfaces;
+
+        // Tiles escritos desde el ultimo clear
+        std::vector<uint8_t> colorDirty;
+        std::vector<uint8_t> depthDirty;
+        std::vector<uint8_t> gbufferDirty;
+};
+
+size_t tileCount(const RenderTarget& target) {
+    return target.tilesX * target.tilesY;
+}
+
+size_t tileIndex(const RenderTarget& target, size_t x, size_t y) {
+    return (y / TILE_SIZE) * target.tilesX + x / TILE_SIZE;
+}
+
+// Pixeles de un tile: [x0, x1) x [y0, y1)
+struct TileRect {
+    size_t x0;
+    size_t y0;
+    size_t x1;
+    size_t y1;
 };
 
-std::array<FragColor, SCREEN_WIDTH * SCREEN_HEIGHT> framebuffer;
+TileRect tileRect(const RenderTarget& target, size_t tile) {
+    size_t x0 = (tile % target.tilesX) * TILE_SIZE;
+    size_t y0 = (tile / target.tilesX) * TILE_SIZE;
+    return TileRect{x0, y0, std::min(x0 + TILE_SIZE, target.width), std::min(y0 + TILE_SIZE, target.height)};
+}
 
-// Create a 2D array of mutexes
-std::array<std::mutex, SCREEN_WIDTH * SCREEN_HEIGHT> mutexes;
+template <typename T>
+void clearTile(const RenderTarget& target, T* buffer, size_t tile, const T& value) {
+    TileRect rect = tileRect(target, tile);
+    for (size_t y = rect.y0; y < rect.y1; ++y) {
+        std::fill(buffer + y * target.width + rect.x0, buffer + y * target.width + rect.x1, value);
+    }
+}
 
-void point(Fragment f) {
-    std::lock_guard<std::mutex> lock(mutexes[f.y * SCREEN_WIDTH + f.x]);
+// Cambia la resolucion; solo reserva memoria si no cabe en lo ya reservado
+void resizeRenderTarget(RenderTarget& target, size_t width, size_t height) {
+    if (width == target.width && height == target.height) {
+        return;
+    }
+    if (width * height > target.capacity) {
+        target = RenderTarget(width, height);
+        return;
+    }
+    target.width = width;
+    target.height = height;
+    target.tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    target.tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    // El layout cambio, asi que todo tiene que limpiarse otra vez
+    target.colorDirty.assign(target.tilesX * target.tilesY, 1);
+    target.depthDirty.assign(target.tilesX * target.tilesY, 1);
+    if (target.gbuffer) {
+        target.gbufferDirty.assign(target.tilesX * target.tilesY, 1);
+    }
+}
+
+void point(RenderTarget& target, const Fragment& f) {
+    size_t index = f.y * target.width + f.x;
+    uint32_t depth = encodeDepth(f.z);
+    if (depth < target.depth[index]) {
+       target.depth[index] = depth;
+       target.color[index] = f.color.toARGB();
+       target.depthDirty[tileIndex(target, f.x, f.y)] = 1;
+       target.colorDirty[tileIndex(target, f.x, f.y)] = 1;
+    }
+}
 
-    if (f.z < framebuffer[f.y * SCREEN_WIDTH + f.x].z) {
-       framebuffer[f.y * SCREEN_WIDTH + f.x] = FragColor{f.color, f.z};
+void clearFramebuffer(RenderTarget& target) {
+    for (size_t tile = 0; tile < tileCount(target); ++tile) {
+        if (target.colorDirty[tile]) {
+            clearTile(target, target.color.get(), tile, blank);
+            target.colorDirty[tile] = 0;
+        }
+        if (target.depthDirty[tile]) {
+            clearTile(target, target.depth.get(), tile, DEPTH_CLEAR);
+            target.depthDirty[tile] = 0;
+        }
     }
 }
 
-void clearFramebuffer() {
-    std::fill(framebuffer.begin(), framebuffer.end(), blank);
+// Mezcla dos pixeles ARGB con t en [0, 256]; dos canales por multiplicacion
+Uint32 lerpARGB(Uint32 a, Uint32 b, uint32_t t) {
+    uint32_t rb = (((a & 0x00FF00FF) * (256 - t) + (b & 0x00FF00FF) * t) >> 8) & 0x00FF00FF;
+    uint32_t ag = (((a >> 8) & 0x00FF00FF) * (256 - t) + ((b >> 8) & 0x00FF00FF) * t) & 0xFF00FF00;
+    return rb | ag;
 }
 
-void renderBuffer(SDL_Renderer* renderer) {
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-    void* texturePixels;
-    int pitch;
-    SDL_LockTexture(texture, NULL, &texturePixels, &pitch);
-
-    Uint32 format = SDL_PIXELFORMAT_ARGB8888;
-    SDL_PixelFormat* mappingFormat = SDL_AllocFormat(format);
-
-    Uint32* texturePixels32 = static_cast<Uint32*>(texturePixels);
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            int framebufferY = SCREEN_HEIGHT - y - 1;  // Reverse the order of rows
-            int index = y * (pitch / sizeof(Uint32)) + x;
-            const Color& color = framebuffer[framebufferY * SCREEN_WIDTH + x].color;
-            if (color.r != 0) {
-                /* print(color); */
-            }
-            texturePixels32[index] = SDL_MapRGBA(mappingFormat, color.r, color.g, color.b, color.a);
+// Columna de origen y peso de cada columna de destino; solo cambia con la resolucion
+struct UpscaleColumns {
+    size_t sourceWidth = 0;
+    std::vector<uint32_t> columns;
+    std::vector<uint32_t> weights;
+};
+
+// Escala bilineal del color del target a una imagen de width x height, en punto fijo de 8 bits
+void upscaleBilinear(const RenderTarget& source, Uint32* destination, size_t width, size_t height, UpscaleColumns& table) {
+    if (table.sourceWidth != source.width || table.columns.size() != width) {
+        table.sourceWidth = source.width;
+        table.columns.resize(width);
+        table.weights.resize(width);
+        for (size_t x = 0; x < width; ++x) {
+            float u = std::clamp((x + 0.5f) * source.width / width - 0.5f, 0.0f, source.width - 1.0f);
+            table.columns[x] = static_cast<uint32_t>(u);
+            table.weights[x] = static_cast<uint32_t>((u - table.columns[x]) * 256.0f);
         }
     }
 
-    SDL_UnlockTexture(texture);
-    SDL_Rect textureRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-    SDL_RenderCopy(renderer, texture, NULL, &textureRect);
-    SDL_DestroyTexture(texture);
+    for (size_t y = 0; y < height; ++y) {
+        float v = std::clamp((y + 0.5f) * source.height / height - 0.5f, 0.0f, source.height - 1.0f);
+        size_t y0 = static_cast<size_t>(v);
+        size_t y1 = std::min(y0 + 1, source.height - 1);
+        uint32_t rowWeight = static_cast<uint32_t>((v - y0) * 256.0f);
+        const Uint32* top = source.color.get() + y0 * source.width;
+        const Uint32* bottom = source.color.get() + y1 * source.width;
+        Uint32* row = destination + y * width;
+        for (size_t x = 0; x < width; ++x) {
+            size_t x0 = table.columns[x];
+            size_t x1 = std::min<size_t>(x0 + 1, source.width - 1);
+            Uint32 upper = lerpARGB(top[x0], top[x1], table.weights[x]);
+            Uint32 lower = lerpARGB(bottom[x0], bottom[x1], table.weights[x]);
+            row[x] = lerpARGB(upper, lower, rowWeight);
+        }
+    }
+}
 
-    SDL_RenderPresent(renderer);
+bool saveBMP(const RenderTarget& target, const char* path) {
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        target.color.get(), static_cast<int>(target.width), static_cast<int>(target.height),
+        32, static_cast<int>(target.width * sizeof(Uint32)), FRAMEBUFFER_FORMAT);
+    if (!surface) {
+        return false;
+    }
+    bool saved = SDL_SaveBMP(surface, path) == 0;
+    SDL_FreeSurface(surface);
+    return saved;
 }
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "fragment.h"
+#include "framebuffer.h"
+#include "shaders.h"
+#include "triangle.h"
+
+GBufferTexel emptyTexel{
+  glm::vec3(0.0f),
+  0,
+  GBUFFER_EMPTY,
+  NO_MODEL
+};
+
+// Codificacion octaedrica: lleva la esfera unitaria a [-1, 1]^2
+uint32_t packNormal(const glm::vec3& n) {
+    glm::vec2 p = glm::vec2(n.x, n.y) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (n.z < 0.0f) {
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    uint32_t x = static_cast<uint32_t>(std::round((glm::clamp(p.x, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f));
+    uint32_t y = static_cast<uint32_t>(std::round((glm::clamp(p.y, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f));
+    return x | (y << 16);
+}
+
+glm::vec3 unpackNormal(uint32_t packed) {
+    glm::vec2 p = glm::vec2(packed & 0xFFFF, packed >> 16) / 65535.0f * 2.0f - 1.0f;
+    glm::vec3 n = glm::vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if (n.z < 0.0f) {
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return glm::normalize(n);
+}
+
+// El G-buffer solo se reserva si el target se usa en modo diferido
+void ensureGBuffer(RenderTarget& target) {
+    if (target.gbuffer) {
+        return;
+    }
+    target.gbuffer = allocateAligned<GBufferTexel>(target.capacity);
+    std::fill(target.gbuffer.get(), target.gbuffer.get() + target.capacity, emptyTexel);
+    target.gbufferDirty.assign(tileCount(target), 0);
+}
+
+// No hace falta limpiarla: readGBuffer() solo la lee si el material del texel pide VARYING_TEX
+// o VARYING_TANGENT
+void ensureGBufferSurfaces(RenderTarget& target) {
+    if (!target.surfaces) {
+        target.surfaces = allocateAligned<GBufferSurface>(target.capacity);
+    }
+}
+
+// Varyings es GBUFFER_VARYINGS, con o sin VARYING_TEX y VARYING_TANGENT
+template <uint8_t Varyings>
+void writeGBuffer(RenderTarget& target, const RasterFragment<Varyings>& f, uint8_t material, uint16_t model) {
+    size_t index = f.y * target.width + f.x;
+    uint32_t depth = encodeDepth(f.z);
+    if (depth < target.depth[index]) {
+        target.depth[index] = depth;
+        if constexpr (RasterFragment<Varyings>::hasTex || RasterFragment<Varyings>::hasTangent) {
+            GBufferSurface& surface = target.surfaces[index];
+            if constexpr (RasterFragment<Varyings>::hasTex) {
+                surface.tex = f.tex;
+                surface.texDx = glm::packHalf2x16(f.texDx);
+                surface.texDy = glm::packHalf2x16(f.texDy);
+            }
+            if constexpr (RasterFragment<Varyings>::hasTangent) {
+                surface.tangent = packNormal(glm::normalize(f.tangent));
+                surface.bitangent = packNormal(glm::normalize(f.bitangent));
+            }
+        }
+        target.gbuffer[index] = GBufferTexel{f.originalPos, packNormal(f.normal), material, model};
+        target.depthDirty[tileIndex(target, f.x, f.y)] = 1;
+        target.gbufferDirty[tileIndex(target, f.x, f.y)] = 1;
+    }
+}
+
+// Arma el Fragment que el camino forward le habria pasado al shader.
+// worldPos no se guarda porque ningun shader lo lee.
+Fragment readGBuffer(const RenderTarget& target, uint16_t x, uint16_t y) {
+    const GBufferTexel& texel = target.gbuffer[y * target.width + x];
+    glm::vec3 normal = unpackNormal(texel.normal);
+    uint8_t varyings = shaderVaryings(static_cast<shaderType>(texel.material));
+    GBufferSurface surface{glm::vec2(0.0f), 0, 0, 0, 0};
+    if (varyings & (VARYING_TEX | VARYING_TANGENT)) {
+        surface = target.surfaces[y * target.width + x];
+    }
+    glm::vec3 tangent = glm::vec3(0.0f);
+    glm::vec3 bitangent = glm::vec3(0.0f);
+    if (varyings & VARYING_TANGENT) {
+        tangent = unpackNormal(surface.tangent);
+        bitangent = unpackNormal(surface.bitangent);
+    }
+    return Fragment{
+        x,
+        y,
+        decodeDepth(target.depth[y * target.width + x]),
+        Color(255, 255, 255),
+        std::max(glm::dot(normal, L), 0.0f),
+        glm::vec3(0.0f),
+        texel.originalPos,
+        normal,
+        surface.tex,
+        glm::unpackHalf2x16(surface.texDx),
+        glm::unpackHalf2x16(surface.texDy),
+        tangent,
+        bitangent
+    };
+}
+
+// Tamano de un pixel en espacio del objeto, medido con los vecinos del mismo modelo
+float pixelFootprint(const RenderTarget& target, size_t x, size_t y) {
+    const GBufferTexel& texel = target.gbuffer[y * target.width + x];
+    float footprint = 0.0f;
+    // Con una sola columna o fila no hay vecino en ese eje
+    if (target.width > 1) {
+        size_t nx = x + 1 < target.width ? x + 1 : x - 1;
+        const GBufferTexel& horizontal = target.gbuffer[y * target.width + nx];
+        if (horizontal.model == texel.model) {
+            footprint = glm::length(horizontal.originalPos - texel.originalPos);
+        }
+    }
+    if (target.height > 1) {
+        size_t ny = y + 1 < target.height ? y + 1 : y - 1;
+        const GBufferTexel& vertical = target.gbuffer[ny * target.width + x];
+        if (vertical.model == texel.model) {
+            footprint = std::max(footprint, glm::length(vertical.originalPos - texel.originalPos));
+        }
+    }
+    return footprint;
+}
+
+void clearGBuffer(RenderTarget& target) {
+    ensureGBuffer(target);
+    for (size_t tile = 0; tile < tileCount(target); ++tile) {
+        if (target.gbufferDirty[tile]) {
+            clearTile(target, target.gbuffer.get(), tile, emptyTexel);
+            target.gbufferDirty[tile] = 0;
+        }
+    }
+}
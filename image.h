@@ -0,0 +1,602 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "color.h"
+
+// Lado maximo y pixeles totales que se aceptan: una cabecera corrupta no deberia pedir gigas de memoria
+constexpr size_t IMAGE_MAX_SIZE = 16384;
+constexpr size_t IMAGE_MAX_PIXELS = size_t(1) << 26; // 8192 x 8192, 256 MiB en ARGB8888
+// Deflate no expande mas de ~1032:1 (una back-reference de 258 bytes en ~2 bits)
+constexpr size_t DEFLATE_MAX_RATIO = 1032;
+
+// Imagen decodificada: un texel ARGB8888 por pixel (el formato del framebuffer), fila 0 arriba
+struct Image {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<Uint32> pixels;
+};
+
+Uint32 packTexel(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return (Uint32(a) << 24) | (Uint32(r) << 16) | (Uint32(g) << 8) | Uint32(b);
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Lee bits de un stream deflate: el primer bit es el menos significativo de cada byte
+class BitReader {
+    public:
+        BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        // Los bits que faltan despues del final se leen como 0; overrun() lo detecta
+        uint32_t peek(uint32_t count) {
+            while (available < count) {
+                uint64_t byte = position < size ? data[position] : 0;
+                position++;
+                buffer |= byte << available;
+                available += 8;
+            }
+            return static_cast<uint32_t>(buffer & ((uint64_t(1) << count) - 1));
+        }
+
+        void skip(uint32_t count) {
+            buffer >>= count;
+            available -= count;
+        }
+
+        uint32_t bits(uint32_t count) {
+            if (count == 0) {
+                return 0;
+            }
+            uint32_t value = peek(count);
+            skip(count);
+            return value;
+        }
+
+        // Descarta lo que queda del byte actual; devuelve el byte siguiente
+        size_t alignToByte() {
+            skip(available % 8);
+            return position - available / 8;
+        }
+
+        void seek(size_t byte) {
+            position = byte;
+            buffer = 0;
+            available = 0;
+        }
+
+        bool overrun() const {
+            return position - available / 8 > size;
+        }
+
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t position = 0;
+        uint64_t buffer = 0;
+        uint32_t available = 0;
+};
+
+constexpr uint32_t HUFFMAN_MAX_BITS = 15;
+
+// Codigo Huffman canonico decodificado con una tabla: se miran maxBits bits de una vez y
+// cada entrada da el simbolo y cuantos bits usa (symbol << 4 | length, 0 si no hay codigo)
+struct HuffmanTable {
+    std::vector<uint16_t> entries;
+    uint32_t maxBits = 0;
+};
+
+bool buildHuffman(const uint8_t* lengths, size_t count, HuffmanTable& table) {
+    uint16_t lengthCount[HUFFMAN_MAX_BITS + 1] = {};
+    for (size_t i = 0; i < count; ++i) {
+        lengthCount[lengths[i]]++;
+    }
+    lengthCount[0] = 0;
+    table.maxBits = 0;
+    for (uint32_t bits = 1; bits <= HUFFMAN_MAX_BITS; ++bits) {
+        if (lengthCount[bits]) {
+            table.maxBits = bits;
+        }
+    }
+    table.entries.assign(size_t(1) << table.maxBits, 0);
+    if (table.maxBits == 0) {
+        return true; // sin codigos: valido si el stream nunca lo usa
+    }
+
+    uint32_t nextCode[HUFFMAN_MAX_BITS + 1] = {};
+    uint32_t code = 0;
+    for (uint32_t bits = 1; bits <= HUFFMAN_MAX_BITS; ++bits) {
+        code = (code + lengthCount[bits - 1]) << 1;
+        nextCode[bits] = code;
+        if (lengthCount[bits] > (1u << bits)) {
+            return false;
+        }
+    }
+    for (size_t symbol = 0; symbol < count; ++symbol) {
+        uint32_t length = lengths[symbol];
+        if (length == 0) {
+            continue;
+        }
+        uint32_t value = nextCode[length]++;
+        if (value >= (1u << length)) {
+            return false; // mas codigos de los que caben
+        }
+        // Los codigos van del bit mas significativo al menos, al reves que el resto del stream
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < length; ++bit) {
+            reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+        }
+        for (uint32_t k = reversed; k < table.entries.size(); k += 1u << length) {
+            table.entries[k] = static_cast<uint16_t>((symbol << 4) | length);
+        }
+    }
+    return true;
+}
+
+// -1 si los bits no son un codigo de la tabla
+int decodeSymbol(BitReader& reader, const HuffmanTable& table) {
+    if (table.maxBits == 0) {
+        return -1;
+    }
+    uint16_t entry = table.entries[reader.peek(table.maxBits)];
+    if (entry == 0) {
+        return -1;
+    }
+    reader.skip(entry & 0xF);
+    return entry >> 4;
+}
+
+constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Falla si out pasaria de `limit` bytes: un archivo chico no puede expandirse sin limite
+bool inflateBlock(BitReader& reader, const HuffmanTable& literals, const HuffmanTable& distances, std::vector<uint8_t>& out,
+                  size_t limit) {
+    while (true) {
+        int symbol = decodeSymbol(reader, literals);
+        if (symbol < 0 || reader.overrun()) {
+            return false;
+        }
+        if (symbol < 256) {
+            if (out.size() >= limit) {
+                return false;
+            }
+            out.push_back(static_cast<uint8_t>(symbol));
+            continue;
+        }
+        if (symbol == 256) {
+            return true;
+        }
+        symbol -= 257;
+        if (symbol >= 29) {
+            return false;
+        }
+        size_t length = LENGTH_BASE[symbol] + reader.bits(LENGTH_EXTRA[symbol]);
+        int distanceSymbol = decodeSymbol(reader, distances);
+        if (distanceSymbol < 0 || distanceSymbol >= 30) {
+            return false;
+        }
+        size_t distance = DISTANCE_BASE[distanceSymbol] + reader.bits(DISTANCE_EXTRA[distanceSymbol]);
+        if (distance > out.size() || length > limit - out.size()) {
+            return false;
+        }
+        // Byte por byte: la copia puede solaparse con lo que esta escribiendo
+        size_t from = out.size() - distance;
+        for (size_t i = 0; i < length; ++i) {
+            out.push_back(out[from + i]);
+        }
+    }
+}
+
+// Deflate (RFC 1951) sin nada alrededor, a lo mas `limit` bytes
+bool inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t limit) {
+    BitReader reader(data, size);
+    HuffmanTable literals;
+    HuffmanTable distances;
+    bool last = false;
+    while (!last) {
+        last = reader.bits(1);
+        uint32_t type = reader.bits(2);
+        if (type == 0) {
+            size_t start = reader.alignToByte();
+            if (start + 4 > size) {
+                return false;
+            }
+            size_t length = data[start] | (data[start + 1] << 8);
+            size_t complement = data[start + 2] | (data[start + 3] << 8);
+            if ((length ^ 0xFFFF) != complement || start + 4 + length > size || length > limit - out.size()) {
+                return false;
+            }
+            out.insert(out.end(), data + start + 4, data + start + 4 + length);
+            reader.seek(start + 4 + length);
+        } else if (type == 1) {
+            uint8_t lengths[288 + 30];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            std::fill(lengths + 288, lengths + 318, 5);
+            buildHuffman(lengths, 288, literals);
+            buildHuffman(lengths + 288, 30, distances);
+            if (!inflateBlock(reader, literals, distances, out, limit)) {
+                return false;
+            }
+        } else if (type == 2) {
+            size_t literalCount = reader.bits(5) + 257;
+            size_t distanceCount = reader.bits(5) + 1;
+            size_t codeCount = reader.bits(4) + 4;
+            constexpr uint8_t CODE_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            uint8_t codeLengths[19] = {};
+            for (size_t i = 0; i < codeCount; ++i) {
+                codeLengths[CODE_ORDER[i]] = static_cast<uint8_t>(reader.bits(3));
+            }
+            HuffmanTable codes;
+            if (!buildHuffman(codeLengths, 19, codes)) {
+                return false;
+            }
+            // Los largos de los dos alfabetos van seguidos y las repeticiones pueden cruzar de uno al otro
+            uint8_t lengths[288 + 32] = {};
+            size_t count = 0;
+            while (count < literalCount + distanceCount) {
+                int symbol = decodeSymbol(reader, codes);
+                if (symbol < 0 || reader.overrun()) {
+                    return false;
+                }
+                size_t repeat = 1;
+                uint8_t value = static_cast<uint8_t>(symbol);
+                if (symbol == 16) {
+                    if (count == 0) {
+                        return false;
+                    }
+                    value = lengths[count - 1];
+                    repeat = 3 + reader.bits(2);
+                } else if (symbol == 17) {
+                    value = 0;
+                    repeat = 3 + reader.bits(3);
+                } else if (symbol == 18) {
+                    value = 0;
+                    repeat = 11 + reader.bits(7);
+                }
+                if (count + repeat > literalCount + distanceCount) {
+                    return false;
+                }
+                std::fill(lengths + count, lengths + count + repeat, value);
+                count += repeat;
+            }
+            if (!buildHuffman(lengths, literalCount, literals) || !buildHuffman(lengths + literalCount, distanceCount, distances)) {
+                return false;
+            }
+            if (!inflateBlock(reader, literals, distances, out, limit)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        if (reader.overrun()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stream zlib (RFC 1950): dos bytes de cabecera, deflate y el adler32 de lo descomprimido
+bool zlibDecompress(const std::vector<uint8_t>& data, std::vector<uint8_t>& out, size_t limit) {
+    if (data.size() < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) {
+        return false;
+    }
+    if (!inflate(data.data() + 2, data.size() - 2, out, limit)) {
+        return false;
+    }
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : out) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    const uint8_t* tail = data.data() + data.size() - 4;
+    uint32_t expected = (uint32_t(tail[0]) << 24) | (uint32_t(tail[1]) << 16) | (uint32_t(tail[2]) << 8) | tail[3];
+    return ((b << 16) | a) == expected;
+}
+
+uint32_t readBigEndian(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// PNG no entrelazado: gris, RGB, paleta, gris + alfa o RGBA; 1 a 16 bits por canal
+bool decodePNG(const std::vector<uint8_t>& file, Image& image, std::string& error) {
+    static constexpr uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (file.size() < 8 || !std::equal(SIGNATURE, SIGNATURE + 8, file.begin())) {
+        error = "not a PNG file";
+        return false;
+    }
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint8_t bitDepth = 0;
+    uint8_t colorType = 0;
+    bool header = false;
+    std::vector<uint8_t> compressed;
+    std::vector<Uint32> palette;
+    size_t offset = 8;
+    while (offset + 12 <= file.size()) {
+        uint32_t length = readBigEndian(&file[offset]);
+        std::string type(file.begin() + offset + 4, file.begin() + offset + 8);
+        const uint8_t* chunk = &file[offset + 8];
+        if (length > file.size() - offset - 12) {
+            error = "truncated chunk";
+            return false;
+        }
+        if (type == "IHDR" && length >= 13) {
+            width = readBigEndian(chunk);
+            height = readBigEndian(chunk + 4);
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            if (chunk[12] != 0) {
+                error = "interlaced PNGs are not supported";
+                return false;
+            }
+            header = true;
+        } else if (type == "PLTE") {
+            palette.clear();
+            for (uint32_t i = 0; i + 3 <= length; i += 3) {
+                palette.push_back(packTexel(chunk[i], chunk[i + 1], chunk[i + 2], 255));
+            }
+        } else if (type == "tRNS" && colorType == 3) {
+            for (uint32_t i = 0; i < length && i < palette.size(); ++i) {
+                palette[i] = (palette[i] & 0x00FFFFFF) | (Uint32(chunk[i]) << 24);
+            }
+        } else if (type == "IDAT") {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        } else if (type == "IEND") {
+            break;
+        }
+        offset += 12 + length;
+    }
+
+    static constexpr uint8_t CHANNELS[7] = {1, 0, 3, 1, 2, 0, 4};
+    if (!header || colorType > 6 || CHANNELS[colorType] == 0 || width == 0 || height == 0) {
+        error = "missing or invalid IHDR";
+        return false;
+    }
+    if (width > IMAGE_MAX_SIZE || height > IMAGE_MAX_SIZE || size_t(width) * height > IMAGE_MAX_PIXELS) {
+        error = "image too large";
+        return false;
+    }
+    // Las profundidades que permite la especificacion para cada tipo de color
+    bool validDepth = false;
+    switch (colorType) {
+        case 0: validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16; break;
+        case 3: validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8; break;
+        default: validDepth = bitDepth == 8 || bitDepth == 16; break;
+    }
+    if (!validDepth || (colorType == 3 && palette.empty())) {
+        error = "unsupported bit depth or missing palette";
+        return false;
+    }
+
+    size_t bitsPerPixel = size_t(CHANNELS[colorType]) * bitDepth;
+    size_t stride = (width * bitsPerPixel + 7) / 8;
+    size_t bpp = std::max<size_t>(bitsPerPixel / 8, 1); // distancia al byte "de la izquierda" de los filtros
+    // Cada fila es su byte de filtro y stride bytes; nada mas puede salir del inflate
+    size_t expected = size_t(height) * (stride + 1);
+    // Antes de reservar nada: los IDAT no alcanzan para lo que dice la cabecera
+    if (expected > compressed.size() * DEFLATE_MAX_RATIO) {
+        error = "truncated image data";
+        return false;
+    }
+    std::vector<uint8_t> raw;
+    raw.reserve(expected);
+    if (!zlibDecompress(compressed, raw, expected)) {
+        error = "corrupt image data";
+        return false;
+    }
+    if (raw.size() < expected) {
+        error = "truncated image data";
+        return false;
+    }
+
+    // Cada fila viene con su filtro contra la fila de arriba y el pixel de la izquierda
+    std::vector<uint8_t> previous(stride, 0);
+    std::vector<uint8_t> row(stride);
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height);
+    for (size_t y = 0; y < height; ++y) {
+        const uint8_t* line = &raw[y * (stride + 1)];
+        uint8_t filter = line[0];
+        for (size_t i = 0; i < stride; ++i) {
+            int left = i >= bpp ? row[i - bpp] : 0;
+            int up = previous[i];
+            int upLeft = i >= bpp ? previous[i - bpp] : 0;
+            int predictor = 0;
+            switch (filter) {
+                case 0: predictor = 0; break;
+                case 1: predictor = left; break;
+                case 2: predictor = up; break;
+                case 3: predictor = (left + up) / 2; break;
+                case 4: predictor = paeth(left, up, upLeft); break;
+                default:
+                    error = "unknown row filter";
+                    return false;
+            }
+            row[i] = static_cast<uint8_t>(line[i + 1] + predictor);
+        }
+
+        Uint32* out = &image.pixels[y * width];
+        for (size_t x = 0; x < width; ++x) {
+            // Canal c del pixel x, reducido a 8 bits
+            auto sample = [&](size_t c) -> uint8_t {
+                if (bitDepth == 16) {
+                    return row[(x * CHANNELS[colorType] + c) * 2];
+                }
+                if (bitDepth == 8) {
+                    return row[x * CHANNELS[colorType] + c];
+                }
+                size_t bit = x * bitDepth;
+                uint32_t value = (row[bit / 8] >> (8 - bitDepth - bit % 8)) & ((1u << bitDepth) - 1);
+                return static_cast<uint8_t>(colorType == 3 ? value : value * 255 / ((1u << bitDepth) - 1));
+            };
+            switch (colorType) {
+                case 0: out[x] = packTexel(sample(0), sample(0), sample(0), 255); break;
+                case 2: out[x] = packTexel(sample(0), sample(1), sample(2), 255); break;
+                case 3: out[x] = sample(0) < palette.size() ? palette[sample(0)] : packTexel(0, 0, 0, 255); break;
+                case 4: out[x] = packTexel(sample(0), sample(0), sample(0), sample(1)); break;
+                case 6: out[x] = packTexel(sample(0), sample(1), sample(2), sample(3)); break;
+            }
+        }
+        std::swap(previous, row);
+    }
+    return true;
+}
+
+// TGA truecolor o gris, sin comprimir o RLE
+bool decodeTGA(const std::vector<uint8_t>& file, Image& image, std::string& error) {
+    if (file.size() < 18) {
+        error = "not a TGA file";
+        return false;
+    }
+    uint8_t idLength = file[0];
+    uint8_t colorMapType = file[1];
+    uint8_t imageType = file[2];
+    size_t colorMapLength = file[5] | (file[6] << 8);
+    size_t colorMapDepth = file[7];
+    size_t width = file[12] | (file[13] << 8);
+    size_t height = file[14] | (file[15] << 8);
+    size_t depth = file[16];
+    bool topDown = (file[17] & 0x20) != 0;
+
+    bool gray = imageType == 3 || imageType == 11;
+    bool rle = imageType == 10 || imageType == 11;
+    if (!(imageType == 2 || imageType == 3 || rle) || width == 0 || height == 0) {
+        error = "unsupported TGA type";
+        return false;
+    }
+    if (width > IMAGE_MAX_SIZE || height > IMAGE_MAX_SIZE || width * height > IMAGE_MAX_PIXELS) {
+        error = "image too large";
+        return false;
+    }
+    size_t bytesPerPixel = depth / 8;
+    if (gray ? depth != 8 : depth != 24 && depth != 32) {
+        error = "unsupported TGA pixel depth";
+        return false;
+    }
+
+    size_t offset = 18 + idLength + (colorMapType ? colorMapLength * ((colorMapDepth + 7) / 8) : 0);
+    // Antes del resize: sin comprimir cada pixel ocupa bytesPerPixel, y con RLE un paquete de
+    // 1 + bytesPerPixel bytes da a lo mas 128 pixeles
+    size_t count = width * height;
+    size_t minimumData = rle ? (count + 127) / 128 * (1 + bytesPerPixel) : count * bytesPerPixel;
+    if (offset > file.size() || file.size() - offset < minimumData) {
+        error = "truncated TGA data";
+        return false;
+    }
+    auto readPixel = [&](size_t at) {
+        const uint8_t* p = &file[at];
+        if (gray) {
+            return packTexel(p[0], p[0], p[0], 255);
+        }
+        return packTexel(p[2], p[1], p[0], bytesPerPixel == 4 ? p[3] : 255);
+    };
+
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(count);
+    size_t written = 0;
+    // En el archivo las filas van de abajo hacia arriba salvo que el descriptor diga lo contrario
+    auto store = [&](Uint32 texel) {
+        size_t y = written / width;
+        size_t x = written % width;
+        image.pixels[(topDown ? y : height - 1 - y) * width + x] = texel;
+        written++;
+    };
+    while (written < count) {
+        if (!rle) {
+            if (offset + bytesPerPixel > file.size()) {
+                break;
+            }
+            store(readPixel(offset));
+            offset += bytesPerPixel;
+            continue;
+        }
+        if (offset >= file.size()) {
+            break;
+        }
+        uint8_t packet = file[offset++];
+        size_t run = (packet & 0x7F) + 1;
+        if (written + run > count) {
+            break;
+        }
+        if (packet & 0x80) {
+            if (offset + bytesPerPixel > file.size()) {
+                break;
+            }
+            Uint32 texel = readPixel(offset);
+            offset += bytesPerPixel;
+            for (size_t i = 0; i < run; ++i) {
+                store(texel);
+            }
+        } else {
+            if (offset + run * bytesPerPixel > file.size()) {
+                break;
+            }
+            for (size_t i = 0; i < run; ++i) {
+                store(readPixel(offset));
+                offset += bytesPerPixel;
+            }
+        }
+    }
+    if (written < count) {
+        error = "truncated TGA data";
+        return false;
+    }
+    return true;
+}
+
+// Decodifica segun la extension: .png o .tga
+bool loadImage(const char* path, Image& image, std::string& error) {
+    std::vector<uint8_t> bytes;
+    if (!readFile(path, bytes)) {
+        error = "cannot open file";
+        return false;
+    }
+    std::string name = path;
+    std::string extension = name.size() >= 4 ? name.substr(name.size() - 4) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".png") {
+        return decodePNG(bytes, image, error);
+    }
+    if (extension == ".tga") {
+        return decodeTGA(bytes, image, error);
+    }
+    error = "unknown image format (only .png and .tga)";
+    return false;
+}
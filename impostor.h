@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "glm/glm.hpp"
+#include "depth.h"
+#include "fragment.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "material.h"
+#include "mesh.h"
+#include "model.h"
+#include "shaders.h"
+#include "triangle.h"
+#include "uniforms.h"
+
+// Un modelo (o instancia) con la bounding sphere por debajo de este radio en pixeles
+// se dibuja con un sprite en vez de sus triangulos
+constexpr float IMPOSTOR_RADIUS = 16.0f;
+
+// Lado del sprite en pixeles, potencia de 2
+constexpr size_t IMPOSTOR_MIN_SIZE = 8;
+constexpr size_t IMPOSTOR_MAX_SIZE = 64;
+
+// Cuanto puede girar la camara o la luz, vistas desde el objeto, antes de volver a capturarlo
+constexpr float IMPOSTOR_MAX_ANGLE = 3.0f; // grados
+
+// Sprites viejos que se vuelven a capturar por frame; los que no tienen sprite no cuentan
+constexpr size_t IMPOSTOR_REFRESH_BUDGET = 64;
+
+// Un impostor a dibujar este frame, armado en la etapa de geometria
+struct ImpostorDraw {
+    uint32_t model;
+    uint32_t instance;       // 0 si el modelo no tiene instancias
+    glm::mat4 modelMatrix;   // uniforms.model de esta instancia
+    glm::vec3 center;        // centro de la bounding sphere en pantalla, z como la del depth buffer
+    float radius;            // en pixeles
+};
+
+// Pixeles que cubre el quad, [x0, x1) x [y0, y1), ya recortados a la pantalla
+TileRect impostorPixels(const ImpostorDraw& draw, size_t width, size_t height) {
+    float x0 = std::clamp(std::floor(draw.center.x - draw.radius), 0.0f, static_cast<float>(width));
+    float y0 = std::clamp(std::floor(draw.center.y - draw.radius), 0.0f, static_cast<float>(height));
+    float x1 = std::clamp(std::ceil(draw.center.x + draw.radius), 0.0f, static_cast<float>(width));
+    float y1 = std::clamp(std::ceil(draw.center.y + draw.radius), 0.0f, static_cast<float>(height));
+    return TileRect{static_cast<size_t>(x0), static_cast<size_t>(y0), static_cast<size_t>(x1), static_cast<size_t>(y1)};
+}
+
+// Sprite cacheado de un modelo o instancia
+struct Impostor {
+    std::optional<RenderTarget> sprite;
+    // Como se veia al capturarlo, en espacio del objeto
+    glm::vec3 viewDirection = glm::vec3(0.0f);
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    // z del centro al capturarlo: el depth del sprite se guarda relativo a el
+    float centerDepth = 0.0f;
+};
+
+size_t spriteSize(float radius) {
+    size_t size = IMPOSTOR_MIN_SIZE;
+    while (size < 2.0f * radius && size < IMPOSTOR_MAX_SIZE) {
+        size *= 2;
+    }
+    return size;
+}
+
+// Direccion del objeto a la camara, en espacio del objeto
+glm::vec3 objectViewDirection(const Uniforms& uniforms, const Mesh& mesh) {
+    glm::vec3 camera = glm::vec3(glm::inverse(uniforms.view)[3]);
+    glm::vec3 local = glm::vec3(glm::inverse(uniforms.model) * glm::vec4(camera, 1.0f));
+    return glm::normalize(local - mesh.center);
+}
+
+// La intensidad es dot(mat3(model) * normal, L) = dot(normal, transpose(mat3(model)) * L)
+glm::vec3 objectLightDirection(const Uniforms& uniforms) {
+    return glm::normalize(glm::transpose(glm::mat3(uniforms.model)) * L);
+}
+
+bool impostorStale(const Impostor& impostor, size_t size, const glm::vec3& viewDirection, const glm::vec3& lightDirection) {
+    float maxCos = std::cos(glm::radians(IMPOSTOR_MAX_ANGLE));
+    return !impostor.sprite
+        || impostor.sprite->width != size
+        || glm::dot(impostor.viewDirection, viewDirection) < maxCos
+        || glm::dot(impostor.lightDirection, lightDirection) < maxCos;
+}
+
+// Forward raster de un mesh entero a un target chico, sin bins ni tiles
+template <shaderType Shader>
+void renderSprite(RenderTarget& sprite, const MeshLevel& level, const Uniforms& uniforms, const Material& material) {
+    using Traits = ShaderTraits<Shader>;
+    VertexTransform transform = vertexTransform(uniforms);
+    TangentFrame frame = tangentFrame(material);
+    TileRect rect{0, 0, sprite.width, sprite.height};
+    for (size_t i = 0; i < level.triangleCount(); ++i) {
+        Vertex vertices[3];
+        for (size_t v = 0; v < 3; ++v) {
+            vertices[v] = vertexShader(meshVertex(level, 3 * i + v, frame), transform);
+        }
+        TriangleSetup t;
+        TriangleSurface surface;
+        if (!setupTriangle(vertices[0], vertices[1], vertices[2], 0, Traits::varyings, sprite.width, sprite.height, t, &surface)) {
+            continue;
+        }
+        triangle<Traits::varyings>(t, &surface, rect, [&](const RasterFragment<Traits::varyings>& rasterized) {
+            if (encodeDepth(rasterized.z) >= sprite.depth[rasterized.y * sprite.width + rasterized.x]) {
+                return;
+            }
+            Fragment fragment = toFragment(rasterized);
+            point(sprite, Traits::shade(fragment, material));
+        });
+    }
+}
+
+// Dibuja el modelo como lo ve la camara ahora, con el cuadrado que lo encierra en `draw`
+// llevado a un sprite de size x size
+void captureImpostor(Impostor& impostor, const ImpostorDraw& draw, Uniforms uniforms, const Model& model, size_t size) {
+    if (!impostor.sprite) {
+        impostor.sprite.emplace(size, size);
+    } else {
+        resizeRenderTarget(*impostor.sprite, size, size);
+    }
+    RenderTarget& sprite = *impostor.sprite;
+    clearFramebuffer(sprite);
+
+    // De pixeles de pantalla a pixeles del sprite, despues del viewport
+    float scale = size / (2.0f * draw.radius);
+    glm::mat4 toSprite = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, 1.0f));
+    toSprite = glm::translate(toSprite, glm::vec3(draw.radius - draw.center.x, draw.radius - draw.center.y, 0.0f));
+    uniforms.viewport = toSprite * uniforms.viewport;
+
+    const Mesh& mesh = *model.mesh;
+    const MeshLevel& level = mesh.levels[selectLevel(mesh, 0.5f * size)];
+    withShader(model.material->shader, [&](auto shader) {
+        renderSprite<decltype(shader)::value>(sprite, level, uniforms, *model.material);
+    });
+
+    impostor.viewDirection = objectViewDirection(uniforms, mesh);
+    impostor.lightDirection = objectLightDirection(uniforms);
+    impostor.centerDepth = draw.center.z;
+}
+
+// Dibuja el sprite como un quad alineado a la pantalla sobre los pixeles de `rect`, con depth test
+// por texel. En modo diferido vacia el texel del G-buffer para que el shading no pinte encima.
+void compositeImpostor(RenderTarget& target, const Impostor& impostor, const ImpostorDraw& draw, const TileRect& rect,
+                       bool deferred) {
+    const RenderTarget& sprite = *impostor.sprite;
+    TileRect pixels = impostorPixels(draw, target.width, target.height);
+    size_t x0 = std::max(pixels.x0, rect.x0);
+    size_t y0 = std::max(pixels.y0, rect.y0);
+    size_t x1 = std::min(pixels.x1, rect.x1);
+    size_t y1 = std::min(pixels.y1, rect.y1);
+    float scale = sprite.width / (2.0f * draw.radius);
+    float left = draw.center.x - draw.radius;
+    float top = draw.center.y - draw.radius;
+    float depthOffset = draw.center.z - impostor.centerDepth;
+
+    for (size_t y = y0; y < y1; ++y) {
+        int sy = static_cast<int>((y + 0.5f - top) * scale);
+        if (sy < 0 || sy >= static_cast<int>(sprite.height)) {
+            continue;
+        }
+        for (size_t x = x0; x < x1; ++x) {
+            int sx = static_cast<int>((x + 0.5f - left) * scale);
+            if (sx < 0 || sx >= static_cast<int>(sprite.width)) {
+                continue;
+            }
+            size_t texel = sy * sprite.width + sx;
+            if (sprite.depth[texel] == DEPTH_CLEAR) {
+                continue;
+            }
+            size_t index = y * target.width + x;
+            uint32_t depth = encodeDepth(decodeDepth(sprite.depth[texel]) + depthOffset);
+            if (depth >= target.depth[index]) {
+                continue;
+            }
+            target.depth[index] = depth;
+            target.color[index] = sprite.color[texel];
+            target.depthDirty[tileIndex(target, x, y)] = 1;
+            target.colorDirty[tileIndex(target, x, y)] = 1;
+            if (deferred) {
+                target.gbuffer[index] = emptyTexel;
+            }
+        }
+    }
+}
+
+// Los sprites de cada modelo e instancia. Solo los usa la etapa de raster.
+class ImpostorCache {
+    public:
+        // Un lugar por modelo e instancia; solo reserva si la escena crecio. Antes de
+        // repartir trabajo, asi las referencias de at() no se invalidan en medio.
+        void resize(const std::vector<Model>& models) {
+            if (impostors.size() < models.size()) {
+                impostors.resize(models.size());
+            }
+            for (size_t model = 0; model < models.size(); ++model) {
+                size_t instances = std::max<size_t>(models[model].instances.size(), 1);
+                if (impostors[model].size() < instances) {
+                    impostors[model].resize(instances);
+                }
+            }
+        }
+
+        Impostor& at(size_t model, size_t instance) {
+            return impostors[model][instance];
+        }
+
+    private:
+        std::vector<std::vector<Impostor>> impostors;
+};
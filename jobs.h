@@ -0,0 +1,229 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Un rango de un parallelFor. Sin std::function para que encolar no reserve memoria.
+struct Job {
+    void (*run)(const void* body, size_t begin, size_t end);
+    const void* body;
+    size_t begin;
+    size_t end;
+    std::atomic<size_t>* pending;
+};
+
+// Deque de un worker: el dueño saca del final (LIFO, lo mas caliente en cache)
+// y los demas roban del principio (FIFO, los rangos mas viejos)
+class WorkQueue {
+    public:
+        static constexpr size_t CAPACITY = 1024;
+
+        bool push(const Job& job) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count == CAPACITY) {
+                return false;
+            }
+            jobs[(head + count) % CAPACITY] = job;
+            count++;
+            return true;
+        }
+
+        bool pop(Job& job) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count == 0) {
+                return false;
+            }
+            count--;
+            job = jobs[(head + count) % CAPACITY];
+            return true;
+        }
+
+        bool steal(Job& job) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count == 0) {
+                return false;
+            }
+            job = jobs[head];
+            head = (head + 1) % CAPACITY;
+            count--;
+            return true;
+        }
+
+    private:
+        std::mutex mutex;
+        std::array<Job, CAPACITY> jobs;
+        size_t head = 0;
+        size_t count = 0;
+};
+
+void pinToCore(std::thread& thread, size_t core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+
+// Job system con work stealing. Se arranca una vez en init(); el hilo que llama a
+// parallelFor tambien trabaja mientras espera, asi que con 0 workers todo corre en serie.
+class JobSystem {
+    public:
+        void start(size_t workerCount, bool pin) {
+            queues.clear();
+            for (size_t i = 0; i < workerCount; ++i) {
+                queues.push_back(std::make_unique<WorkQueue>());
+            }
+            stopping = false;
+            for (size_t i = 0; i < workerCount; ++i) {
+                workers.emplace_back(&JobSystem::workerLoop, this, i);
+                if (pin) {
+                    // El core 0 queda para el hilo principal
+                    pinToCore(workers.back(), i + 1);
+                }
+            }
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker: workers) {
+                worker.join();
+            }
+            workers.clear();
+            queues.clear();
+        }
+
+        size_t workerCount() const {
+            return workers.size();
+        }
+
+        // Llama a body(chunkBegin, chunkEnd) sobre [begin, end) en pedazos de `grain` y espera a todos
+        template <typename F>
+        void parallelFor(size_t begin, size_t end, size_t grain, const F& body) {
+            if (begin >= end) {
+                return;
+            }
+            grain = std::max<size_t>(grain, 1);
+            size_t chunks = (end - begin + grain - 1) / grain;
+            if (workers.empty() || chunks == 1) {
+                // Mismos rangos que en paralelo: hay cuerpos que indexan por begin / grain
+                for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grain) {
+                    body(chunkBegin, std::min(chunkBegin + grain, end));
+                }
+                return;
+            }
+
+            std::atomic<size_t> pending{chunks};
+            Job job{
+                [](const void* context, size_t chunkBegin, size_t chunkEnd) {
+                    (*static_cast<const F*>(context))(chunkBegin, chunkEnd);
+                },
+                &body, 0, 0, &pending
+            };
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                job.begin = begin + chunk * grain;
+                job.end = std::min(job.begin + grain, end);
+                if (!submit(job)) {
+                    execute(job);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+
+            // Ayuda con lo que haya en las colas hasta que terminen todos los rangos
+            while (pending.load(std::memory_order_acquire) > 0) {
+                Job other;
+                if (findJob(other)) {
+                    execute(other);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t NOT_A_WORKER = static_cast<size_t>(-1);
+        static inline thread_local size_t workerIndex = NOT_A_WORKER;
+
+        bool submit(const Job& job) {
+            size_t target = workerIndex != NOT_A_WORKER ? workerIndex : nextQueue++ % queues.size();
+            if (!queues[target]->push(job)) {
+                return false;
+            }
+            queuedJobs.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+
+        bool findJob(Job& job) {
+            size_t self = workerIndex;
+            if (self != NOT_A_WORKER && queues[self]->pop(job)) {
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            size_t start = self != NOT_A_WORKER ? self + 1 : 0;
+            for (size_t i = 0; i < queues.size(); ++i) {
+                size_t victim = (start + i) % queues.size();
+                if (victim != self && queues[victim]->steal(job)) {
+                    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void execute(const Job& job) {
+            job.run(job.body, job.begin, job.end);
+            job.pending->fetch_sub(1, std::memory_order_release);
+        }
+
+        void workerLoop(size_t index) {
+            workerIndex = index;
+            while (true) {
+                Job job;
+                if (findJob(job)) {
+                    execute(job);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this] { return queuedJobs.load(std::memory_order_acquire) > 0 || stopping; });
+                if (stopping && queuedJobs.load() == 0) {
+                    return;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queuedJobs{0};
+        std::atomic<size_t> nextQueue{0};
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+};
+
+JobSystem jobs;
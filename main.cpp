@@ -2,9 +2,21 @@
 #include <iostream>
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
 #include <vector>
 #include <sstream>
 #include <cassert>
+#include <array>
+#include <optional>
+#include <string>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <random>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include "color.h"
 #include "print.h"
 #include "framebuffer.h"
@@ -15,34 +27,89 @@
 #include "camera.h"
 #include "ObjLoader.h"
 #include "noise.h"
+#include "mesh.h"
+#include "texture.h"
 #include "model.h"
+#include "material.h"
+#include "gbuffer.h"
+#include "present.h"
+#include "resolution.h"
+#include "temporal.h"
+#include "jobs.h"
+#include "impostor.h"
+#include "pipeline.h"
+#include "sphere.h"
+#include "scene.h"
+#include "profiler.h"
 
 SDL_Window* window = nullptr;
-SDL_Renderer* renderer = nullptr;
+Presenter presenter;
+ResolutionController resolution;
 Color currentColor;
 
 std::vector<Model> models;
+SceneGraph scene;
+bool deferredShading = true;
+// Reuso temporal del shading, solo en modo diferido
+bool temporalReuse = false;
+TemporalHistory history;
+// Shading de resolucion variable por modelo, solo en modo diferido
+bool variableRateShading = true;
+// LOD por instancia segun su tamaño en pantalla, ver mesh.h
+bool levelOfDetail = true;
+// Sprites para lo que se ve muy chico, ver impostor.h
+bool impostors = true;
+ImpostorCache impostorCache;
+std::vector<uint32_t> impostorRefresh; // se reusa entre frames
+size_t impostorCursor = 0;
+// Ray casting para los modelos PRIMITIVE_SPHERE, ver sphere.h
+bool analyticSpheres = true;
+std::atomic<size_t> shaderInvocations{0};
+
+// 0 workers = todo en el hilo principal
+size_t workerThreads = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0;
+bool pinWorkers = false;
+// Frames que la geometria puede ir por delante del raster
+size_t framesInFlight = 1;
+// Asteroides del cinturon, 0 = sin cinturon
+size_t asteroidCount = 0;
+// OBJ extra con su textura de color (.png o .tga); vacio = sin modelo extra
+std::string texturedModelPath;
+std::string texturePath;
+// Normal map opcional para ese modelo; vacio = solo la textura de color
+std::string normalMapPath;
+NormalMapSpace normalMapSpace = NORMAL_MAP_TANGENT;
+bool benchTexture = false;
+
+size_t screenWidth = 800;
+size_t screenHeight = 600;
+// Si no esta vacio se renderiza un solo frame a este BMP, sin ventana
+std::string outputPath;
 
 bool init() {
+    setupNoise();
+    jobs.start(workerThreads, pinWorkers);
+
+    if (!outputPath.empty()) {
+        return true;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         std::cerr << "Error: Failed to initialize SDL: " << SDL_GetError() << std::endl;
         return false;
     }
 
-    window = SDL_CreateWindow("Software Renderer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    window = SDL_CreateWindow("Software Renderer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                              static_cast<int>(screenWidth), static_cast<int>(screenHeight), SDL_WINDOW_SHOWN);
     if (!window) {
         std::cerr << "Error: Failed to create SDL window: " << SDL_GetError() << std::endl;
         return false;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        std::cerr << "Error: Failed to create SDL renderer: " << SDL_GetError() << std::endl;
+    if (!presenter.start(window, screenWidth, screenHeight)) {
         return false;
     }
 
-    setupNoise();
-
     return true;
 }
 
@@ -50,122 +117,528 @@ void setColor(const Color& color) {
     currentColor = color;
 }
 
-void render() {
+// Solo para el pase diferido, donde el material cambia de un pixel a otro
+Fragment shadeFragment(Fragment& fragment, const Material& material) {
+    Fragment shaded = fragment;
+    withShader(material.shader, [&](auto shader) {
+        shaded = ShaderTraits<decltype(shader)::value>::shade(fragment, material);
+    });
+    return shaded;
+}
+
+// Un color ya sombreado dentro de un bloque de 4x4, compartido por los pixeles
+// del mismo modelo que caen en el mismo sub-bloque de su shading rate
+struct CoarseSample {
+    uint16_t model;
+    uint8_t rate;
+    uint8_t block;
+    HistoryTexel shaded;
+};
+
+uint32_t pixelShadingRate(const RenderTarget& target, size_t x, size_t y, uint16_t model) {
+    if (!variableRateShading || model >= models.size()) {
+        return 1;
+    }
+    ShadingRate rate = models[model].shadingRate;
+    if (rate != SHADING_RATE_AUTO) {
+        return rate;
+    }
+    // El bloque mas grande que no cubra mas de AUTO_SHADING_BLOCK del objeto
+    float footprint = pixelFootprint(target, x, y);
+    if (footprint <= 0.0f) {
+        return 1;
+    }
+    for (uint32_t candidate : {4u, 2u}) {
+        if (footprint * candidate <= AUTO_SHADING_BLOCK) {
+            return candidate;
+        }
+    }
+    return 1;
+}
+
+// Pasada diferida: a lo sumo una llamada al shader por pixel cubierto, solo en tiles con geometria
+void shadeTile(RenderTarget& target, size_t tile) {
+    TileRect rect = tileRect(target, tile);
+    size_t invocations = 0;
+    size_t reused = 0;
+    size_t shadedCount = 0;
+    for (size_t by = rect.y0; by < rect.y1; by += SHADING_RATE_4X4) {
+        for (size_t bx = rect.x0; bx < rect.x1; bx += SHADING_RATE_4X4) {
+            std::array<CoarseSample, 16> samples;
+            size_t sampleCount = 0;
+
+            for (size_t y = by; y < std::min(by + SHADING_RATE_4X4, rect.y1); ++y) {
+                for (size_t x = bx; x < std::min(bx + SHADING_RATE_4X4, rect.x1); ++x) {
+                    const GBufferTexel& texel = target.gbuffer[y * target.width + x];
+                    if (texel.material == GBUFFER_EMPTY) {
+                        if (temporalReuse) {
+                            recordHistory(history, x, y, emptyHistory);
+                        }
+                        continue;
+                    }
+                    // El depth test ya se hizo al llenar el G-buffer
+                    Fragment fragment = readGBuffer(target, static_cast<uint16_t>(x), static_cast<uint16_t>(y));
+
+                    HistoryTexel previous;
+                    // history solo guarda la transformacion del modelo, no la de cada instancia
+                    if (temporalReuse && !needsRefresh(history, x, y) && models[texel.model].instances.empty()
+                        && reproject(history, fragment.originalPos, fragment.intensity, pixelFootprint(target, x, y), texel.model, previous)) {
+                        target.color[y * target.width + x] = previous.color;
+                        recordHistory(history, x, y, previous);
+                        reused++;
+                        continue;
+                    }
+
+                    // Depth y cobertura siguen siendo por pixel; solo el color se comparte
+                    uint32_t rate = pixelShadingRate(target, x, y, texel.model);
+                    uint8_t block = static_cast<uint8_t>(((y - by) / rate) * 4 + (x - bx) / rate);
+                    const CoarseSample* sample = nullptr;
+                    for (size_t i = 0; i < sampleCount; ++i) {
+                        if (samples[i].model == texel.model && samples[i].rate == rate && samples[i].block == block) {
+                            sample = &samples[i];
+                            break;
+                        }
+                    }
+
+                    HistoryTexel shaded;
+                    if (sample) {
+                        shaded = sample->shaded;
+                    } else {
+                        Uint32 color = shadeFragment(fragment, *models[texel.model].material).color.toARGB();
+                        shaded = HistoryTexel{fragment.originalPos, fragment.intensity, color, texel.model};
+                        invocations++;
+                        if (rate > 1) {
+                            samples[sampleCount++] = CoarseSample{texel.model, static_cast<uint8_t>(rate), block, shaded};
+                        }
+                    }
+
+                    target.color[y * target.width + x] = shaded.color;
+                    if (temporalReuse) {
+                        recordHistory(history, x, y, shaded);
+                        shadedCount++;
+                    }
+                }
+            }
+        }
+    }
+    target.colorDirty[tile] = 1;
+
+    // Un solo atomico por tile en vez de uno por pixel
+    shaderInvocations.fetch_add(invocations, std::memory_order_relaxed);
+    history.reused.fetch_add(reused, std::memory_order_relaxed);
+    history.shaded.fetch_add(shadedCount, std::memory_order_relaxed);
+}
+
+void shadeGBuffer(RenderTarget& target) {
+    shaderInvocations = 0;
+    // Cada tile escribe solo sus propios pixeles, asi que no hace falta sincronizar nada
+    jobs.parallelFor(0, tileCount(target), TILE_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            if (target.gbufferDirty[tile]) {
+                shadeTile(target, tile);
+            }
+        }
+    });
+}
+
+// Forward: el shader es un parametro del template, asi que se inlinea en el loop de pixeles.
+// El depth test va antes del shader; el resultado es el mismo porque los shaders no tocan z.
+template <shaderType Shader>
+void rasterizeForward(RenderTarget& target, const FrameGeometry& geometry, const uint32_t* first, const uint32_t* last,
+                      const TileRect& rect, const Material& material) {
+    using Traits = ShaderTraits<Shader>;
+    for (const uint32_t* k = first; k != last; ++k) {
+        triangle<Traits::varyings>(geometry.triangles[*k], triangleSurface(geometry, *k), rect, [&](const RasterFragment<Traits::varyings>& rasterized) {
+            if (encodeDepth(rasterized.z) >= target.depth[rasterized.y * target.width + rasterized.x]) {
+                return;
+            }
+            Fragment fragment = toFragment(rasterized);
+            point(target, Traits::shade(fragment, material));
+        });
+    }
+}
+
+template <shaderType Shader>
+void rasterizeForwardSphere(RenderTarget& target, const SphereDraw& s, const TileRect& rect, const Material& material) {
+    using Traits = ShaderTraits<Shader>;
+    sphere<Traits::varyings>(s, rect, [&](const RasterFragment<Traits::varyings>& rasterized) {
+        if (encodeDepth(rasterized.z) >= target.depth[rasterized.y * target.width + rasterized.x]) {
+            return;
+        }
+        Fragment fragment = toFragment(rasterized);
+        point(target, Traits::shade(fragment, material));
+    });
+}
 
-    for (auto& model: models){
-        // 1. Vertex Shader
-        std::vector<Vertex> transformedVertices(model.VBO.size() / 3);
-        for (size_t i = 0; i < model.VBO.size() / 3; ++i) {
-            Vertex vertex = { model.VBO[i * 3], model.VBO[i * 3 + 1], model.VBO[i * 3 + 2] };
-            transformedVertices[i] = vertexShader(vertex, model.uniforms);
+// Vuelve a capturar los sprites que faltan o que cambiaron demasiado. De los que ya tenian
+// sprite solo se hacen IMPOSTOR_REFRESH_BUDGET por frame, empezando donde quedo el anterior,
+// asi un cinturon entero que gira no se recaptura todo en el mismo frame.
+void refreshImpostors(const FrameGeometry& geometry) {
+    impostorCache.resize(models);
+    impostorRefresh.clear();
+    size_t budget = IMPOSTOR_REFRESH_BUDGET;
+    size_t start = geometry.impostorCount > 0 ? impostorCursor % geometry.impostorCount : 0;
+    for (size_t n = 0; n < geometry.impostorCount; ++n) {
+        size_t k = (start + n) % geometry.impostorCount;
+        const ImpostorDraw& draw = geometry.impostors[k];
+        const Impostor& impostor = impostorCache.at(draw.model, draw.instance);
+        if (!impostor.sprite) {
+            impostorRefresh.push_back(static_cast<uint32_t>(k));
+            continue;
+        }
+        if (budget == 0) {
+            continue;
+        }
+        Uniforms uniforms = geometry.uniforms[draw.model];
+        uniforms.model = draw.modelMatrix;
+        if (impostorStale(impostor, spriteSize(draw.radius), objectViewDirection(uniforms, *models[draw.model].mesh),
+                          objectLightDirection(uniforms))) {
+            impostorRefresh.push_back(static_cast<uint32_t>(k));
+            impostorCursor = k + 1;
+            budget--;
         }
+    }
 
-        // 2. Primitive Assembly
-        std::vector<std::vector<Vertex>> assembledVertices(transformedVertices.size() / 3);
-        for (size_t i = 0; i < transformedVertices.size() / 3; ++i) {
-            Vertex edge1 = transformedVertices[3 * i];
-            Vertex edge2 = transformedVertices[3 * i + 1];
-            Vertex edge3 = transformedVertices[3 * i + 2];
-            assembledVertices[i] = { edge1, edge2, edge3 };
+    jobs.parallelFor(0, impostorRefresh.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const ImpostorDraw& draw = geometry.impostors[impostorRefresh[i]];
+            Uniforms uniforms = geometry.uniforms[draw.model];
+            uniforms.model = draw.modelMatrix;
+            captureImpostor(impostorCache.at(draw.model, draw.instance), draw, uniforms, models[draw.model],
+                            spriteSize(draw.radius));
         }
+    });
+}
+
+void rasterizeTile(RenderTarget& target, const FrameGeometry& geometry, size_t tile) {
+    TileRect rect = tileRect(target, tile);
+    const uint32_t* first = geometry.binTriangles + geometry.binOffsets[tile];
+    const uint32_t* last = geometry.binTriangles + geometry.binOffsets[tile + 1];
+
+    // Los impostores ya vienen sombreados; el depth test los ordena con los triangulos
+    for (uint32_t k = geometry.impostorBinOffsets[tile]; k < geometry.impostorBinOffsets[tile + 1]; ++k) {
+        const ImpostorDraw& draw = geometry.impostors[geometry.impostorBins[k]];
+        compositeImpostor(target, impostorCache.at(draw.model, draw.instance), draw, rect, deferredShading);
+    }
 
-        // 3. Rasterization
-        std::vector<Fragment> fragments;
-        for (size_t i = 0; i < assembledVertices.size(); ++i) {
-            std::vector<Fragment> rasterizedTriangle = triangle(
-                    assembledVertices[i][0],
-                    assembledVertices[i][1],
-                    assembledVertices[i][2]
-            );
-            fragments.insert(fragments.end(), rasterizedTriangle.begin(), rasterizedTriangle.end());
+    for (uint32_t k = geometry.sphereBinOffsets[tile]; k < geometry.sphereBinOffsets[tile + 1]; ++k) {
+        const SphereDraw& s = geometry.spheres[geometry.sphereBins[k]];
+        const Material& material = *models[s.model].material;
+        if (deferredShading) {
+            uint8_t shader = static_cast<uint8_t>(material.shader);
+            sphere<GBUFFER_VARYINGS>(s, rect, [&](const RasterFragment<GBUFFER_VARYINGS>& fragment) {
+                writeGBuffer(target, fragment, shader, s.model);
+            });
+        } else {
+            withShader(material.shader, [&](auto shader) {
+                rasterizeForwardSphere<decltype(shader)::value>(target, s, rect, material);
+            });
         }
+    }
 
-        // 4. Fragment Shader
-        for (size_t i = 0; i < fragments.size(); ++i) {
-            Fragment& fragment = fragments[i];
-            shaderType currentShader = model.currentShader;
-
-            switch (currentShader) {
-                case SOL:
-                    fragment = sol(fragment);
-                    break;
-                case TIERRA:
-                    fragment = tierra(fragment);
-                    break;
-                case GASEOSO:
-                    fragment = gaseoso(fragment);
-                    break;
-                case LUNA:
-                    fragment = luna(fragment);
-                    break;
-                case ANILLOS:
-                    fragment = anillos(fragment);
-                    break;
-                case PLANETA_ANILLOS:
-                    fragment = platenaAnillos(fragment);
-                    break;
-                case SOL_AMARILLO:
-                    fragment = solAmarillo(fragment);
-                    break;
-                    // Añade más casos para otros shaders
+    if (deferredShading) {
+        for (const uint32_t* k = first; k != last; ++k) {
+            const TriangleSetup& t = geometry.triangles[*k];
+            shaderType shader = models[t.model].material->shader;
+            uint8_t material = static_cast<uint8_t>(shader);
+            // uv y marco tangente solo para los shaders que los leen
+            constexpr uint8_t NormalMapped = GBUFFER_VARYINGS | VARYING_TEX | VARYING_TANGENT;
+            if (shaderVaryings(shader) & VARYING_TANGENT) {
+                triangle<NormalMapped>(t, triangleSurface(geometry, *k), rect, [&](const RasterFragment<NormalMapped>& fragment) {
+                    writeGBuffer(target, fragment, material, t.model);
+                });
+            } else if (shaderVaryings(shader) & VARYING_TEX) {
+                triangle<GBUFFER_VARYINGS | VARYING_TEX>(t, triangleSurface(geometry, *k), rect, [&](const RasterFragment<GBUFFER_VARYINGS | VARYING_TEX>& fragment) {
+                    writeGBuffer(target, fragment, material, t.model);
+                });
+            } else {
+                triangle<GBUFFER_VARYINGS>(t, rect, [&](const RasterFragment<GBUFFER_VARYINGS>& fragment) {
+                    writeGBuffer(target, fragment, material, t.model);
+                });
             }
-            point(fragment); // Be aware of potential race conditions here
         }
+        return;
+    }
+
+    // Un solo dispatch por cada tramo de triangulos seguidos del mismo modelo
+    while (first != last) {
+        uint16_t model = geometry.triangles[*first].model;
+        const uint32_t* runEnd = first;
+        while (runEnd != last && geometry.triangles[*runEnd].model == model) {
+            ++runEnd;
+        }
+        const Material& material = *models[model].material;
+        withShader(material.shader, [&](auto shader) {
+            rasterizeForward<decltype(shader)::value>(target, geometry, first, runEnd, rect, material);
+        });
+        first = runEnd;
+    }
+}
+
+// Rasterizacion y shading de un frame cuya geometria ya armo el pipeline
+void render(RenderTarget& target, const FrameGeometry& geometry) {
+    if (deferredShading && temporalReuse) {
+        beginHistoryFrame(history, target, geometry.uniforms);
+    }
+
+    refreshImpostors(geometry);
+    if (deferredShading && (geometry.varyings & (VARYING_TEX | VARYING_TANGENT))) {
+        ensureGBufferSurfaces(target);
+    }
+
+    // 1. Rasterization + Fragment Shader (o G-buffer en modo diferido), un tile por job.
+    // Los tiles no comparten pixeles, asi que el depth test no necesita atomicos.
+    jobs.parallelFor(0, tileCount(target), TILE_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            rasterizeTile(target, geometry, tile);
+        }
+    });
+
+    // 2. Deferred shading
+    if (deferredShading) {
+        shadeGBuffer(target);
+    }
+}
+
+// Con reversed-Z la proyeccion misma lleva el near a z = 1 y el far a 0: z = n (f - d) / (d (f - n))
+// sale de la division ya cerca de 0 para lo lejano, donde el float tiene mas precision. Invertir
+// despues de la division (1 - z) solo daria vuelta el depth test: los valores lejanos ya se
+// habrian redondeado cerca de 1.
+glm::mat4 createProjectionMatrix(float fovInDegrees, float aspectRatio, float nearClip, float farClip) {
+    glm::mat4 projection = glm::perspective(glm::radians(fovInDegrees), aspectRatio, nearClip, farClip);
+    if (depthFormat == DEPTH_FLOAT32_REVERSED) {
+        projection[2][2] = nearClip / (farClip - nearClip);
+        projection[3][2] = farClip * nearClip / (farClip - nearClip);
     }
+    return projection;
 }
 
 glm::mat4 createViewportMatrix(size_t screenWidth, size_t screenHeight) {
+    // Mapea NDC z [-1, 1] a [0, 1]; con reversed-Z la proyeccion ya lo deja en [0, 1]
+    bool reversed = depthFormat == DEPTH_FLOAT32_REVERSED;
     glm::mat4 viewport = glm::mat4(1.0f);
-    viewport = glm::scale(viewport, glm::vec3(screenWidth / 2.0f, screenHeight / 2.0f, 0.5f));
-    viewport = glm::translate(viewport, glm::vec3(1.0f, 1.0f, 0.5f));
-    return viewport;
+    viewport = glm::scale(viewport, glm::vec3(screenWidth / 2.0f, screenHeight / 2.0f, reversed ? 1.0f : 0.5f));
+    viewport = glm::translate(viewport, glm::vec3(1.0f, 1.0f, reversed ? 0.0f : 1.0f));
+
+    // Invierte Y aqui para que la fila 0 del framebuffer sea la de arriba, como en la textura
+    glm::mat4 flipY = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, screenHeight - 1.0f, 0.0f));
+    flipY = glm::scale(flipY, glm::vec3(1.0f, -1.0f, 1.0f));
+    return flipY * viewport;
 }
 
-int main(int argc, char* argv[]) {
-    if (!init()) {
+bool parseDepthFormat(const std::string& name) {
+    if (name == "float") {
+        depthFormat = DEPTH_FLOAT32;
+    } else if (name == "reversed") {
+        depthFormat = DEPTH_FLOAT32_REVERSED;
+    } else if (name == "unorm24") {
+        depthFormat = DEPTH_UNORM24;
+    } else if (name == "unorm32") {
+        depthFormat = DEPTH_UNORM32;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Numero que ocupa todo `text`; a diferencia de stoul/stof no lanza excepciones, no acepta
+// basura al final y no deja pasar un negativo a un tipo sin signo
+template <typename T>
+bool parseNumber(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    auto [next, error] = std::from_chars(text, end, value);
+    return error == std::errc() && next == end;
+}
+
+int invalidValue(const std::string& option, const char* value) {
+    std::cerr << "Error: Invalid value for " << option << ": " << value << std::endl;
+    return 1;
+}
+
+// Matrices de las instancias del cinturon: un anillo alrededor del planeta, cada
+// asteroide con su propio tamaño y orientacion. Misma semilla, mismo cinturon.
+std::vector<glm::mat4> asteroidBelt(size_t count) {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::mat4> instances;
+    instances.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        float angle = glm::two_pi<float>() * unit(random);
+        float radius = glm::mix(0.95f, 1.35f, unit(random));
+        float height = glm::mix(-0.04f, 0.04f, unit(random));
+        float size = glm::mix(0.02f, 0.06f, unit(random));
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+        glm::mat4 instance = glm::translate(glm::mat4(1.0f), glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle)));
+        instance = glm::rotate(instance, glm::two_pi<float>() * unit(random), axis);
+        instances.push_back(glm::scale(instance, glm::vec3(size)));
+    }
+    return instances;
+}
+
+// --bench-texture: sampleTrilinear sobre la textura de --texture con cada layout, como la
+// recorreria un cuadrado de 1024x1024 pixeles girado a distintos angulos. El checksum tiene
+// que dar igual en todos: solo cambia donde esta cada texel.
+int runTextureBenchmark(const char* path) {
+    Image image;
+    std::string error;
+    if (!loadImage(path, image, error)) {
+        std::cerr << "Error: Failed to load texture " << path << ": " << error << std::endl;
         return 1;
     }
+    const char* layoutNames[] = {"linear", "tiled", "morton"};
+    Texture textures[] = {buildTexture(image, TEXTURE_LINEAR), buildTexture(image, TEXTURE_TILED),
+                          buildTexture(image, TEXTURE_MORTON)};
+    struct Pattern {
+        const char* name;
+        float degrees;
+        float scale; // texels de levels[0] por pixel
+    };
+    const Pattern patterns[] = {{"0 deg", 0.0f, 1.0f}, {"45 deg", 45.0f, 1.0f}, {"90 deg", 90.0f, 1.0f},
+                                {"90 deg, x4 minified", 90.0f, 4.0f}};
+    const size_t side = 1024;
+    const size_t repeats = 3;
+    std::printf("%s: %zux%zu, %zu levels, %zu samples per pattern\n", path, image.width, image.height,
+                textures[0].levels.size(), side * side);
+
+    for (const Pattern& pattern : patterns) {
+        float angle = glm::radians(pattern.degrees);
+        glm::vec2 dx = pattern.scale * glm::vec2(std::cos(angle) / image.width, std::sin(angle) / image.height);
+        glm::vec2 dy = pattern.scale * glm::vec2(-std::sin(angle) / image.width, std::cos(angle) / image.height);
+        double linearNs = 0.0;
+        float linearChecksum = 0.0f;
+        for (size_t layout = 0; layout < 3; ++layout) {
+            double bestNs = 0.0;
+            float checksum = 0.0f;
+            for (size_t repeat = 0; repeat < repeats; ++repeat) {
+                checksum = 0.0f;
+                Uint64 start = SDL_GetPerformanceCounter();
+                for (size_t y = 0; y < side; ++y) {
+                    glm::vec2 row = static_cast<float>(y) * dy;
+                    for (size_t x = 0; x < side; ++x) {
+                        glm::vec2 uv = row + static_cast<float>(x) * dx;
+                        checksum += glm::dot(sampleTrilinear(textures[layout], uv, dx, dy), glm::vec4(1.0f));
+                    }
+                }
+                double ns = 1e9 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency() / (side * side);
+                bestNs = repeat == 0 ? ns : std::min(bestNs, ns);
+            }
+            if (layout == TEXTURE_LINEAR) {
+                linearNs = bestNs;
+                linearChecksum = checksum;
+            }
+            if (checksum != linearChecksum) {
+                std::cerr << "Error: " << layoutNames[layout] << " layout samples differ from linear" << std::endl;
+                return 1;
+            }
+            std::printf("%-20s %-7s %6.2f ns/sample  x%.2f\n", pattern.name, layoutNames[layout], bestNs, linearNs / bestNs);
+        }
+    }
+    return 0;
+}
 
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec3> texCoords;
-    std::vector<Face> faces;
-    std::vector<glm::vec3> vertexBufferObject;
-
-    loadOBJ("C:\\Users\\caste\\OneDrive\\Documentos\\Universidad\\semestre6\\"
-            "graficosxcomputador\\lab4\\sphere.obj",
-            vertices, normals, texCoords, faces);
-
-    for (const auto& face : faces) {
-        for (int i = 0; i < 3; ++i) {
-            glm::vec3 vertexPosition = vertices[face.vertexIndices[i]];
-            glm::vec3 vertexNormal = normals[face.normalIndices[i]];
-            glm::vec3 vertexTexture = texCoords[face.texIndices[i]];
-            vertexBufferObject.push_back(vertexPosition);
-            vertexBufferObject.push_back(vertexNormal);
-            vertexBufferObject.push_back(vertexTexture);
+int main(int argc, char* argv[]) {
+    if (const char* threads = std::getenv("LAB4_THREADS")) {
+        if (!parseNumber(threads, workerThreads)) {
+            return invalidValue("LAB4_THREADS", threads);
+        }
+    }
+    if (const char* pin = std::getenv("LAB4_PIN")) {
+        pinWorkers = std::string(pin) != "0";
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--depth" && i + 1 < argc) {
+            if (!parseDepthFormat(argv[++i])) {
+                std::cerr << "Error: Unknown depth format: " << argv[i] << " (float, reversed, unorm24, unorm32)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--width" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], screenWidth) || screenWidth == 0) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--height" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], screenHeight) || screenHeight == 0) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--budget" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], resolution.budgetMs) || !std::isfinite(resolution.budgetMs)) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--temporal") {
+            temporalReuse = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], workerThreads)) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--pin") {
+            pinWorkers = true;
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], framesInFlight)) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--asteroids" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], asteroidCount)) {
+                return invalidValue(arg, argv[i]);
+            }
+        } else if (arg == "--model" && i + 1 < argc) {
+            texturedModelPath = argv[++i];
+        } else if (arg == "--texture" && i + 1 < argc) {
+            texturePath = argv[++i];
+        } else if (arg == "--normal-map" && i + 1 < argc) {
+            normalMapPath = argv[++i];
+            normalMapSpace = NORMAL_MAP_TANGENT;
+        } else if (arg == "--world-normal-map" && i + 1 < argc) {
+            normalMapPath = argv[++i];
+            normalMapSpace = NORMAL_MAP_OBJECT;
+        } else if (arg == "--bench-texture") {
+            benchTexture = true;
         }
     }
 
-    std::vector<glm::vec3> verticesAnillos;
-    std::vector<glm::vec3> normalsAnillos;
-    std::vector<glm::vec3> texCoordsAnillos;
-    std::vector<Face> facesAnillos;
-    std::vector<glm::vec3> vertexBufferObjectAnillos;
-
-    loadOBJ("C:\\Users\\caste\\OneDrive\\Documentos\\"
-            "Universidad\\semestre6\\graficosxcomputador\\lab4\\anillos.obj",
-            verticesAnillos, normalsAnillos, texCoordsAnillos, facesAnillos);
-
-    for (const auto& face : facesAnillos) {
-        for (int i = 0; i < 3; ++i) {
-            glm::vec3 vertexPosition = verticesAnillos[face.vertexIndices[i]];
-            glm::vec3 vertexNormal = normalsAnillos[face.normalIndices[i]];
-            glm::vec3 vertexTexture = texCoordsAnillos[face.texIndices[i]];
-            vertexBufferObjectAnillos.push_back(vertexPosition);
-            vertexBufferObjectAnillos.push_back(vertexNormal);
-            vertexBufferObjectAnillos.push_back(vertexTexture);
+    if (benchTexture) {
+        if (texturePath.empty()) {
+            std::cerr << "Error: --bench-texture needs --texture" << std::endl;
+            return 1;
         }
+        return runTextureBenchmark(texturePath.c_str());
+    }
+
+    if (texturedModelPath.empty() != texturePath.empty()) {
+        std::cerr << "Error: --model and --texture go together" << std::endl;
+        return 1;
+    }
+    if (!normalMapPath.empty() && texturedModelPath.empty()) {
+        std::cerr << "Error: a normal map needs --model and --texture" << std::endl;
+        return 1;
+    }
+
+    if (!init()) {
+        jobs.stop();
+        return 1;
+    }
+
+    // Un solo mesh por archivo, compartido por todos los modelos que lo usan
+    std::shared_ptr<const Mesh> sphere = loadMesh("C:\\Users\\caste\\OneDrive\\Documentos\\Universidad\\semestre6\\"
+                                                  "graficosxcomputador\\lab4\\sphere.obj");
+    std::shared_ptr<const Mesh> anillosMesh = loadMesh("C:\\Users\\caste\\OneDrive\\Documentos\\"
+                                                       "Universidad\\semestre6\\graficosxcomputador\\lab4\\anillos.obj");
+    std::shared_ptr<const Mesh> texturedMesh;
+    std::shared_ptr<const Texture> texture;
+    std::shared_ptr<const Texture> normalMap;
+    if (!texturedModelPath.empty()) {
+        texturedMesh = loadMesh(texturedModelPath.c_str());
+        texture = loadTexture(texturePath.c_str());
+    }
+    if (!normalMapPath.empty()) {
+        normalMap = loadTexture(normalMapPath.c_str());
+    }
+    if (!sphere || !anillosMesh || (!texturedModelPath.empty() && (!texturedMesh || !texture))
+        || (!normalMapPath.empty() && !normalMap)) {
+        presenter.stop();
+        jobs.stop();
+        return 1;
     }
 
     Uniforms uniforms;
@@ -179,78 +652,117 @@ int main(int argc, char* argv[]) {
     camera.upVector = glm::vec3(0.0f, 1.0f, 0.0f);
 
     float fovInDegrees = 45.0f;
-    float aspectRatio = static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT);
+    float aspectRatio = static_cast<float>(screenWidth) / static_cast<float>(screenHeight);
     float nearClip = 0.1f;
     float farClip = 100.0f;
-    uniforms.projection = glm::perspective(glm::radians(fovInDegrees), aspectRatio, nearClip, farClip);
+    uniforms.projection = createProjectionMatrix(fovInDegrees, aspectRatio, nearClip, farClip);
 
-    uniforms.viewport = createViewportMatrix(SCREEN_WIDTH, SCREEN_HEIGHT);
     Uint32 frameStart, frameTime;
     std::string title = "FPS: ";
     int speed = 10;
 
+    // Escena: cada cuerpo tiene un nodo que gira sobre si mismo, colgado de un nodo de
+    // orbita. Los hijos (lunas, anillos) cuelgan de la orbita del padre y no de su cuerpo,
+    // asi lo siguen sin heredar su escala ni su giro.
+    uint32_t sistema = scene.addNode(SceneNode{});
+    uint32_t solNode = scene.addNode(SceneNode{sistema, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 0.3f});
+    uint32_t orbitaTierra = scene.addNode(SceneNode{sistema, glm::vec3(0.0f, 0.0f, 0.0f)}); // (1.5, 0, 0)
+    uint32_t tierraNode = scene.addNode(SceneNode{orbitaTierra, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 0.8f,
+                                                  glm::vec3(0.5f)});
+    uint32_t orbitaLuna = scene.addNode(SceneNode{orbitaTierra, glm::vec3(0.5f, 0.3f, 0.0f)});
+    uint32_t lunaNode = scene.addNode(SceneNode{orbitaLuna, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 1.5f,
+                                                glm::vec3(0.25f)});
+    uint32_t solAmarilloNode = scene.addNode(SceneNode{sistema, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 0.3f});
+    uint32_t orbitaPlaneta = scene.addNode(SceneNode{sistema});
+    uint32_t planetaNode = scene.addNode(SceneNode{orbitaPlaneta, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 0.8f,
+                                                   glm::vec3(0.5f)});
+    uint32_t anillosNode = scene.addNode(SceneNode{orbitaPlaneta, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, 1.5f,
+                                                   glm::vec3(0.75f)});
+    // El cinturon gira entero, inclinado para que no se vea de canto
+    uint32_t inclinacionCinturon = scene.addNode(SceneNode{orbitaPlaneta, glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 20.0f});
+    uint32_t cinturonNode = scene.addNode(SceneNode{inclinacionCinturon, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 0.2f});
+
     Model sol;
-    sol.VBO = vertexBufferObject;
-    sol.currentShader = SOL;
-    sol.uniforms = uniforms;
-    sol.modelMatrix = glm::mat4(1.0f);
+    sol.mesh = sphere;
+    sol.primitive = PRIMITIVE_SPHERE;
+    sol.material = std::make_shared<const Material>(solMaterial());
+    sol.node = solNode;
 
     // models.push_back(sol);
 
     Model tierra;
-    tierra.VBO = vertexBufferObject;
-    tierra.currentShader = TIERRA;
-    tierra.uniforms = uniforms;
-    tierra.modelMatrix = glm::mat4(1.0f);
+    tierra.mesh = sphere;
+    tierra.primitive = PRIMITIVE_SPHERE;
+    tierra.material = std::make_shared<const Material>(tierraMaterial());
+    tierra.node = tierraNode;
 
     // models.push_back(tierra);
 
     Model luna;
-    luna.VBO = vertexBufferObject;
-    luna.currentShader = LUNA;
-    luna.uniforms = uniforms;
-    luna.modelMatrix = glm::mat4(1.0f);
+    luna.mesh = sphere;
+    luna.primitive = PRIMITIVE_SPHERE;
+    luna.material = std::make_shared<const Material>(lunaMaterial());
+    luna.shadingRate = SHADING_RATE_2X2;
+    luna.node = lunaNode;
 
     // models.push_back(luna);
 
     Model solAmarillo;
-    solAmarillo.VBO = vertexBufferObject;
-    solAmarillo.currentShader = SOL_AMARILLO;
-    solAmarillo.uniforms = uniforms;
-    solAmarillo.modelMatrix = glm::mat4(1.0f);
+    solAmarillo.mesh = sphere;
+    solAmarillo.primitive = PRIMITIVE_SPHERE;
+    solAmarillo.material = std::make_shared<const Material>(solAmarilloMaterial());
+    solAmarillo.node = solAmarilloNode;
 
     //models.push_back(solAmarillo);
 
     Model planetaAnillos;
-    planetaAnillos.VBO = vertexBufferObject;
-    planetaAnillos.currentShader = PLANETA_ANILLOS;
-    planetaAnillos.uniforms = uniforms;
-    planetaAnillos.modelMatrix = glm::mat4(1.0f);
+    planetaAnillos.mesh = sphere;
+    planetaAnillos.primitive = PRIMITIVE_SPHERE;
+    planetaAnillos.material = std::make_shared<const Material>(planetaAnillosMaterial());
+    planetaAnillos.shadingRate = SHADING_RATE_AUTO;
+    planetaAnillos.node = planetaNode;
 
     models.push_back(planetaAnillos);
 
     Model anillos;
-    anillos.VBO = vertexBufferObjectAnillos;
-    anillos.currentShader = ANILLOS;
-    anillos.uniforms = uniforms;
-    anillos.modelMatrix = glm::mat4(1.0f);
+    anillos.mesh = anillosMesh;
+    anillos.material = std::make_shared<const Material>(anillosMaterial());
+    anillos.node = anillosNode;
 
     models.push_back(anillos);
 
+    // Cinturon de asteroides: la misma esfera instanciada, un solo modelo para todos
+    if (asteroidCount > 0) {
+        Model cinturon;
+        cinturon.mesh = sphere;
+        cinturon.primitive = PRIMITIVE_SPHERE;
+        cinturon.material = std::make_shared<const Material>(materialVariant(lunaMaterial(), 7));
+        cinturon.node = cinturonNode;
+        cinturon.instances = asteroidBelt(asteroidCount);
+        models.push_back(cinturon);
+    }
 
+    // Modelo con textura a la izquierda del planeta, girando sobre si mismo
+    if (texturedMesh) {
+        uint32_t orbitaModelo = scene.addNode(SceneNode{sistema, glm::vec3(-1.1f, 0.0f, 0.0f)});
+        Model textured;
+        textured.mesh = texturedMesh;
+        textured.material = std::make_shared<const Material>(
+            normalMap ? texturaNormalesMaterial(texture, normalMap, normalMapSpace) : texturaMaterial(texture));
+        textured.node = scene.addNode(SceneNode{orbitaModelo, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 0.5f,
+                                                glm::vec3(0.5f)});
+        models.push_back(textured);
+    }
 
-    // Posicion de los astros
-    glm::vec3 newTranslationVector(0.0f, 0.0f, 0.0f);
-
-    // Rotacion de los astros
-    float rotaSol = 45.0f;
-    float rotaTierra = 45.0f;
-    float rotaLuna = 45.0f;
-    glm::vec3 rotationAxis(0.0f, 1.0f, 0.0f);
+    std::optional<RenderTarget> offlineTarget;
+    if (!outputPath.empty()) {
+        offlineTarget.emplace(screenWidth, screenHeight);
+    }
 
-    // Tamaño de los astros
-    glm::vec3 scaleFactor(1.0f, 1.0f, 1.0f);
+    // Un render offline es un solo frame, no tiene sentido adelantar la geometria
+    pipeline.start(models, offlineTarget ? 0 : framesInFlight);
 
+    size_t lastAllocations = allocations();
     bool running = true;
     while (running) {
         frameStart = SDL_GetTicks();
@@ -274,6 +786,24 @@ int main(int argc, char* argv[]) {
                     case SDLK_DOWN:
                         camera.cameraPosition.y += speed;
                         break;
+                    case SDLK_d:
+                        deferredShading = !deferredShading;
+                        break;
+                    case SDLK_t:
+                        temporalReuse = !temporalReuse;
+                        break;
+                    case SDLK_v:
+                        variableRateShading = !variableRateShading;
+                        break;
+                    case SDLK_l:
+                        levelOfDetail = !levelOfDetail;
+                        break;
+                    case SDLK_i:
+                        impostors = !impostors;
+                        break;
+                    case SDLK_s:
+                        analyticSpheres = !analyticSpheres;
+                        break;
                 }
             }
         }
@@ -284,71 +814,88 @@ int main(int argc, char* argv[]) {
                 camera.upVector
         );
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-        clearFramebuffer();
-        glm::mat4 rotation = glm::mat4(1.0f);
-        for (auto& model: models){
-            switch (model.currentShader) {
-                case SOL:
-                    rotaSol += 0.3f;
-                    newTranslationVector = glm::vec3(0.0f, 0.0f, 0.0f);
-                    scaleFactor = glm::vec3(1.0f, 1.0f, 1.0f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaSol), rotationAxis);
-                    break;
-                case TIERRA:
-                    rotaTierra += 0.8f;
-                    newTranslationVector = glm::vec3(0.0f, 0.0f, 0.0f);
-                    // newTranslationVector = glm::vec3(1.5f, 0.0f, 0.0f);
-                    scaleFactor = glm::vec3(0.5f, 0.5f, 0.5f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaTierra), rotationAxis);
-                    break;
-                case LUNA:
-                    rotaLuna += 1.5f;
-                    newTranslationVector = glm::vec3(0.5f, 0.3f, 0.0f);
-                    // newTranslationVector = glm::vec3(2.0f, 0.3f, 0.0f);
-                    scaleFactor = glm::vec3(0.25f, 0.25f, 0.25f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaLuna), rotationAxis);
-                    break;
-                case SOL_AMARILLO:
-                    rotaSol += 0.3f;
-                    newTranslationVector = glm::vec3(0.0f, 0.0f, 0.0f);
-                    scaleFactor = glm::vec3(1.0f, 1.0f, 1.0f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaSol), rotationAxis);
-                    break;
-                case PLANETA_ANILLOS:
-                    rotaTierra += 0.8f;
-                    newTranslationVector = glm::vec3(0.0f, 0.0f, 0.0f);
-                    scaleFactor = glm::vec3(0.5f, 0.5f, 0.5f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaTierra), rotationAxis);
-                    break;
-                case ANILLOS:
-                    rotaLuna += 1.5f;
-                    newTranslationVector = glm::vec3(0.0f, 0.0f, 0.0f);
-                    scaleFactor = glm::vec3(0.75f, 0.75f, 0.75f);
-                    rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotaLuna), rotationAxis);
-                    break;
-            }
-            glm::mat4 translation = glm::translate(glm::mat4(1.0f), newTranslationVector);
-            glm::mat4 scale = glm::scale(glm::mat4(1.0f), scaleFactor);
-            uniforms.model = translation * rotation * scale;
-            model.uniforms = uniforms;
+        // Input de este frame; la geometria corre en el hilo del pipeline
+        FrameInput& input = pipeline.beginFrame();
+        input.width = offlineTarget ? screenWidth : resolution.scaled(screenWidth);
+        input.height = offlineTarget ? screenHeight : resolution.scaled(screenHeight);
+        input.uniforms.clear();
+        input.levelOfDetail = levelOfDetail;
+        input.impostors = impostors;
+        input.analyticSpheres = analyticSpheres;
+        uniforms.viewport = createViewportMatrix(input.width, input.height);
+        scene.animate();
+        scene.update();
+        for (const auto& model: models){
+            uniforms.model = scene.worldMatrix(model.node);
+            input.uniforms.push_back(uniforms);
         }
+        pipeline.submitFrame();
 
-        render();
+        if (!pipeline.rasterDue()) {
+            continue;
+        }
 
-        renderBuffer(renderer);
+        // Raster y shading del frame mas viejo en vuelo, mientras el pipeline prepara el siguiente
+        const FrameGeometry& geometry = pipeline.waitGeometry();
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        RenderTarget& target = offlineTarget ? *offlineTarget : presenter.backBuffer();
+        resizeRenderTarget(target, geometry.width, geometry.height);
+        clearFramebuffer(target);
+        if (deferredShading) {
+            clearGBuffer(target);
+        }
+        render(target, geometry);
+        float geometryMs = geometry.buildMs;
+        size_t submittedTriangles = geometry.submittedTriangles;
+        size_t impostorCount = geometry.impostorCount;
+        size_t sphereCount = geometry.sphereCount;
+        pipeline.releaseFrame();
+        resolution.addFrameTime(geometryMs + 1000.0f * (SDL_GetPerformanceCounter() - renderStart) / SDL_GetPerformanceFrequency());
+
+        if (offlineTarget) {
+            if (!saveBMP(target, outputPath.c_str())) {
+                std::cerr << "Error: Failed to save " << outputPath << ": " << SDL_GetError() << std::endl;
+                pipeline.stop();
+                jobs.stop();
+                return 1;
+            }
+            break;
+        }
+
+        renderBuffer(presenter);
 
         frameTime = SDL_GetTicks() - frameStart;
 
+        // Llamadas a new desde el titulo anterior, en todos los hilos; en estado estable deberia ser 0
+        size_t frameAllocations = allocations() - lastAllocations;
+        lastAllocations = allocations();
+
         if (frameTime > 0) {
-            std::ostringstream titleStream;
-            titleStream << "FPS: " << 1000.0 / frameTime;
-            SDL_SetWindowTitle(window, titleStream.str().c_str());
+            // snprintf a un buffer fijo para que el titulo tampoco reserve memoria
+            char titleText[256];
+            int length = std::snprintf(titleText, sizeof(titleText), "FPS: %.1f (%zux%zu) allocs: %zu tris: %zu",
+                                       1000.0 / frameTime, target.width, target.height, frameAllocations, submittedTriangles);
+            if (sphereCount > 0) {
+                length += std::snprintf(titleText + length, sizeof(titleText) - length, " spheres: %zu", sphereCount);
+            }
+            if (impostorCount > 0) {
+                length += std::snprintf(titleText + length, sizeof(titleText) - length, " impostors: %zu (%zu refreshed)",
+                                        impostorCount, impostorRefresh.size());
+            }
+            if (deferredShading) {
+                length += std::snprintf(titleText + length, sizeof(titleText) - length, " shaded: %zu", shaderInvocations.load());
+            }
+            if (deferredShading && temporalReuse && history.reused + history.shaded > 0) {
+                std::snprintf(titleText + length, sizeof(titleText) - length, " reuse: %zu%%",
+                              100 * history.reused / (history.reused + history.shaded));
+            }
+            SDL_SetWindowTitle(window, titleText);
         }
     }
 
-    SDL_DestroyRenderer(renderer);
+    pipeline.stop();
+    presenter.stop();
+    jobs.stop();
     SDL_DestroyWindow(window);
     SDL_Quit();
 
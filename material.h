@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <memory>
+#include "glm/glm.hpp"
+#include "FastNoise.h"
+#include "texture.h"
+#include "model.h"
+
+// Un generador de ruido ya configurado y como se muestrea: (p + offset) * scale
+struct NoiseLayer {
+    FastNoiseLite generator;
+    glm::vec3 offset = glm::vec3(0.0f);
+    float scale = 1.0f;
+
+    float sample(const glm::vec2& p) const {
+        return generator.GetNoise((p.x + offset.x) * scale, (p.y + offset.y) * scale);
+    }
+
+    float sample(const glm::vec3& p) const {
+        return generator.GetNoise((p.x + offset.x) * scale, (p.y + offset.y) * scale, (p.z + offset.z) * scale);
+    }
+};
+
+NoiseLayer noiseLayer(FastNoiseLite::NoiseType type, const glm::vec3& offset, float scale) {
+    NoiseLayer layer;
+    layer.generator.SetNoiseType(type);
+    layer.offset = offset;
+    layer.scale = scale;
+    return layer;
+}
+
+// En que espacio estan las normales de Material::normalMap
+enum NormalMapSpace {
+    NORMAL_MAP_TANGENT, // relativas a la superficie del mesh, como diablo3_nm.png
+    NORMAL_MAP_OBJECT,  // en espacio del objeto, como diablo3_nm_world.png
+};
+
+// Bloque de uniforms de un material: las constantes que lee su shader, calculadas una
+// vez al crearlo. El significado de cada campo depende del shader (ver shaders.h).
+// Varios modelos pueden compartir un material, y un shader puede tener muchos materiales.
+struct Material {
+    shaderType shader;
+    std::array<glm::vec3, 4> colors{};
+    std::array<NoiseLayer, 3> noise;
+    float frequency = 0.0f;
+    float amplitude = 0.0f;
+    std::shared_ptr<const Texture> texture; // color base, TEXTURA y TEXTURA_NORMALES
+    std::shared_ptr<const Texture> normalMap; // solo TEXTURA_NORMALES
+    NormalMapSpace normalSpace = NORMAL_MAP_TANGENT;
+};
+
+// Los materiales originales de cada shader
+
+Material solMaterial() {
+    Material material;
+    material.shader = SOL;
+    material.noise[0] = noiseLayer(FastNoiseLite::NoiseType_Perlin, glm::vec3(10000.0f, 10000.0f, 0.0f), 9000.0f);
+    material.amplitude = 0.1f; // rango del cambio de tono
+    return material;
+}
+
+Material solAmarilloMaterial() {
+    Material material;
+    material.shader = SOL_AMARILLO;
+    material.colors[0] = glm::vec3(252.0f / 255.0f, 211.0f / 255.0f, 0.0f / 255.0f);
+    material.colors[1] = glm::vec3(252.0f / 255.0f, 163.0f / 255.0f, 0.0f / 255.0f);
+    material.noise[0] = noiseLayer(FastNoiseLite::NoiseType_Perlin, glm::vec3(10000.0f, 10000.0f, 0.0f), 9000.0f);
+    material.frequency = 5.0f; // estiramiento vertical del ruido
+    return material;
+}
+
+Material tierraMaterial() {
+    Material material;
+    material.shader = TIERRA;
+    material.colors[0] = glm::vec3(0.44f, 0.51f, 0.33f); // suelo
+    material.colors[1] = glm::vec3(0.97f, 0.53f, 0.18f); // suelo 2
+    material.colors[2] = glm::vec3(0.12f, 0.38f, 0.57f); // oceano
+    material.colors[3] = glm::vec3(1.0f, 1.0f, 1.0f);    // nubes
+    material.noise[0] = noiseLayer(FastNoiseLite::NoiseType_OpenSimplex2, glm::vec3(1200.0f, 3000.0f, 0.0f), 400.0f);
+    material.noise[1] = noiseLayer(FastNoiseLite::NoiseType_Perlin, glm::vec3(5500.0f, 6900.0f, 0.0f), 900.0f);
+    material.noise[2] = noiseLayer(FastNoiseLite::NoiseType_OpenSimplex2, glm::vec3(5500.0f, 6900.0f, 0.0f), 300.0f);
+    return material;
+}
+
+Material gaseosoMaterial() {
+    Material material;
+    material.shader = GASEOSO;
+    material.colors[0] = glm::vec3(163.0f / 255.0f, 135.0f / 255.0f, 115.0f / 255.0f);
+    material.frequency = 15.0f;
+    material.amplitude = 0.1f;
+    return material;
+}
+
+Material lunaMaterial() {
+    Material material;
+    material.shader = LUNA;
+    material.colors[0] = glm::vec3(0.8f, 0.8f, 0.8f);
+    material.colors[1] = glm::vec3(0.6f, 0.6f, 0.6f);
+    material.noise[0] = noiseLayer(FastNoiseLite::NoiseType_OpenSimplex2, glm::vec3(5000.0f, 8000.0f, 0.0f), 500.0f);
+    material.amplitude = 0.1f;
+    return material;
+}
+
+Material anillosMaterial() {
+    Material material;
+    material.shader = ANILLOS;
+    material.colors[0] = glm::vec3(0.0f, 188.0f / 255.0f, 159.0f / 255.0f);
+    material.colors[1] = glm::vec3(51.0f, 108.0f / 255.0f, 99.0f / 255.0f);
+    material.noise[0] = noiseLayer(FastNoiseLite::NoiseType_Perlin, glm::vec3(5000.0f, 8000.0f, 300.0f), 500.0f);
+    material.amplitude = 0.1f;
+    return material;
+}
+
+Material planetaAnillosMaterial() {
+    Material material;
+    material.shader = PLANETA_ANILLOS;
+    material.colors[0] = glm::vec3(0.0f, 188.0f / 255.0f, 159.0f / 255.0f);
+    material.frequency = 15.0f;
+    material.amplitude = 0.1f;
+    return material;
+}
+
+Material texturaMaterial(std::shared_ptr<const Texture> texture) {
+    Material material;
+    material.shader = TEXTURA;
+    material.texture = std::move(texture);
+    return material;
+}
+
+Material texturaNormalesMaterial(std::shared_ptr<const Texture> texture, std::shared_ptr<const Texture> normalMap,
+                                 NormalMapSpace space) {
+    Material material;
+    material.shader = TEXTURA_NORMALES;
+    material.texture = std::move(texture);
+    material.normalMap = std::move(normalMap);
+    material.normalSpace = space;
+    return material;
+}
+
+// Otra variante del mismo material: mismo shader y parametros, otro patron de ruido
+Material materialVariant(Material material, int seed) {
+    for (NoiseLayer& layer : material.noise) {
+        layer.generator.SetSeed(seed);
+    }
+    return material;
+}
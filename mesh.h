@@ -0,0 +1,374 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ObjLoader.h"
+
+// Resoluciones de la grilla de cada LOD generado (celdas en el eje mas largo del mesh)
+constexpr int LOD_GRID_RESOLUTIONS[] = {32, 24, 16, 12, 8, 6, 4, 3, 2};
+
+// Error maximo de un LOD, en pixeles, para que se use en vez de uno mas detallado
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+// Un LOD solo se guarda si tiene a lo mas esta fraccion de los triangulos del anterior
+constexpr float LOD_MIN_REDUCTION = 0.75f;
+
+// Una version del mesh. Sin indices: posicion, normal y uv de cada vertice, tres
+// vertices por triangulo.
+struct MeshLevel {
+    std::vector<glm::vec3> VBO;
+    // Una por vertice del VBO: direccion en que crece u, perpendicular a la normal, y en w
+    // el signo de la bitangente (-1 si la uv esta espejada), ver buildTangents()
+    std::vector<glm::vec4> tangents;
+    // Cuanto puede separarse de la superficie original, en espacio del objeto
+    float error = 0.0f;
+
+    size_t triangleCount() const {
+        return VBO.size() / 9;
+    }
+};
+
+// Geometria inmutable de un OBJ. Los modelos la comparten por shared_ptr<const Mesh>,
+// asi cinco esferas son una sola copia de los vertices.
+struct Mesh {
+    // levels[0] es el original; los demas, cada vez mas simples, ver buildLods()
+    std::vector<MeshLevel> levels;
+    // Esfera que envuelve al mesh, para elegir el LOD
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// La parte de `tangent` perpendicular a `normal`, normalizada. Si no queda nada (uv
+// degenerada) cualquier perpendicular sirve: el normal map ahi no tiene detalle.
+glm::vec3 orthogonalTangent(const glm::vec3& normal, const glm::vec3& tangent) {
+    glm::vec3 t = tangent - normal * glm::dot(normal, tangent);
+    float length = glm::length(t);
+    if (length > 1e-6f) {
+        return t / length;
+    }
+    glm::vec3 axis = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(axis, normal));
+}
+
+// Marco tangente por vertice (Lengyel): cada triangulo aporta las direcciones en que crecen
+// u y v sobre su superficie a los vertices que usa, los que comparten posicion, uv y normal
+// en el OBJ. Despues la tangente se hace perpendicular a la normal y la bitangente queda como
+// un signo. Los vertices de `faces` son los de original.VBO, en el mismo orden.
+void buildTangents(MeshLevel& original, const std::vector<Face>& faces) {
+    std::vector<std::array<int, 3>> keys;
+    keys.reserve(faces.size() * 3);
+    for (const Face& face : faces) {
+        for (int i = 0; i < 3; ++i) {
+            keys.push_back({face.vertexIndices[i], face.texIndices[i], face.normalIndices[i]});
+        }
+    }
+    // Un indice por vertice distinto del OBJ
+    std::vector<uint32_t> order(keys.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    std::vector<uint32_t> shared(keys.size());
+    uint32_t unique = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i > 0 && keys[order[i]] != keys[order[i - 1]]) {
+            unique++;
+        }
+        shared[order[i]] = unique;
+    }
+
+    std::vector<glm::vec3> tangents(keys.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(keys.size(), glm::vec3(0.0f));
+    for (size_t t = 0; t < original.triangleCount(); ++t) {
+        const glm::vec3* v = &original.VBO[t * 9];
+        glm::vec3 e1 = v[3] - v[0];
+        glm::vec3 e2 = v[6] - v[0];
+        glm::vec2 d1 = glm::vec2(v[5] - v[2]);
+        glm::vec2 d2 = glm::vec2(v[8] - v[2]);
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (std::abs(det) < 1e-12f) {
+            continue;
+        }
+        glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) / det;
+        glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) / det;
+        for (size_t k = 0; k < 3; ++k) {
+            tangents[shared[t * 3 + k]] += tangent;
+            bitangents[shared[t * 3 + k]] += bitangent;
+        }
+    }
+
+    original.tangents.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        glm::vec3 normal = original.VBO[i * 3 + 1];
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        glm::vec3 tangent = orthogonalTangent(normal, tangents[shared[i]]);
+        float handedness = glm::dot(glm::cross(normal, tangent), bitangents[shared[i]]) < 0.0f ? -1.0f : 1.0f;
+        original.tangents[i] = glm::vec4(tangent, handedness);
+    }
+}
+
+// Quadric clustering (Lindstrom 2000): los vertices que caen en la misma celda de una
+// grilla se juntan en uno, puesto donde minimiza la distancia a los planos de sus
+// triangulos. Los triangulos que quedan con dos vertices en la misma celda desaparecen.
+MeshLevel clusterMesh(const MeshLevel& source, const glm::vec3& boundsMin, const glm::vec3& boundsMax, int resolution) {
+    glm::vec3 extent = boundsMax - boundsMin;
+    float cellSize = std::max(std::max(extent.x, extent.y), extent.z) / resolution;
+    glm::ivec3 cells = glm::max(glm::ivec3(glm::ceil(extent / cellSize)), glm::ivec3(1));
+
+    auto cellOf = [&](const glm::vec3& p) {
+        glm::ivec3 c = glm::clamp(glm::ivec3((p - boundsMin) / cellSize), glm::ivec3(0), cells - 1);
+        return static_cast<uint32_t>((c.z * cells.y + c.y) * cells.x + c.x);
+    };
+
+    // Lo que se acumula por celda: la quadric sum(n n^T), sum(-d n), y los promedios
+    struct Cluster {
+        glm::mat3 A = glm::mat3(0.0f);
+        glm::vec3 b = glm::vec3(0.0f);
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        glm::vec3 tex = glm::vec3(0.0f);
+        glm::vec3 tangent = glm::vec3(0.0f);
+        float handedness = 0.0f;
+        float count = 0.0f;
+    };
+    std::vector<Cluster> clusters(static_cast<size_t>(cells.x) * cells.y * cells.z);
+    std::vector<uint32_t> vertexCell(source.VBO.size() / 3);
+
+    for (size_t t = 0; t < source.triangleCount(); ++t) {
+        const glm::vec3* v = &source.VBO[t * 9];
+        glm::vec3 cross = glm::cross(v[3] - v[0], v[6] - v[0]);
+        float length = glm::length(cross);
+        // Plano n . x + d = 0 pesado por el area, asi los triangulos chicos pesan poco
+        glm::vec3 n = length > 0.0f ? cross / length : glm::vec3(0.0f);
+        float d = -glm::dot(n, v[0]);
+        float area = 0.5f * length;
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t cell = cellOf(v[k * 3]);
+            vertexCell[t * 3 + k] = cell;
+            Cluster& cluster = clusters[cell];
+            cluster.A += area * glm::outerProduct(n, n);
+            cluster.b -= area * d * n;
+            cluster.position += v[k * 3];
+            cluster.normal += v[k * 3 + 1];
+            cluster.tex += v[k * 3 + 2];
+            if (!source.tangents.empty()) {
+                const glm::vec4& tangent = source.tangents[t * 3 + k];
+                cluster.tangent += glm::vec3(tangent);
+                cluster.handedness += tangent.w;
+            }
+            cluster.count += 1.0f;
+        }
+    }
+
+    std::vector<glm::vec3> representative(clusters.size());
+    for (size_t cell = 0; cell < clusters.size(); ++cell) {
+        Cluster& cluster = clusters[cell];
+        if (cluster.count == 0.0f) {
+            continue;
+        }
+        glm::vec3 mean = cluster.position / cluster.count;
+        // En las direcciones que los planos no fijan (una cara plana, un borde) se queda
+        // en el promedio: un poco de regularizacion hacia el evita un sistema singular
+        float lambda = 1e-3f * (cluster.A[0][0] + cluster.A[1][1] + cluster.A[2][2]) + 1e-12f;
+        glm::vec3 p = glm::inverse(cluster.A + glm::mat3(lambda)) * (cluster.b + lambda * mean);
+        glm::vec3 cellMin = boundsMin + glm::vec3(glm::ivec3(cell % cells.x, (cell / cells.x) % cells.y, cell / (cells.x * cells.y))) * cellSize;
+        glm::vec3 slack = glm::vec3(0.5f * cellSize);
+        if (!(glm::all(glm::greaterThanEqual(p, cellMin - slack)) && glm::all(glm::lessThanEqual(p, cellMin + cellSize + slack)))) {
+            p = mean;
+        }
+        representative[cell] = p;
+        float normalLength = glm::length(cluster.normal);
+        cluster.normal = normalLength > 0.0f ? cluster.normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        cluster.tex /= cluster.count;
+        cluster.tangent = orthogonalTangent(cluster.normal, cluster.tangent);
+    }
+
+    // Un triangulo por cada trio de celdas distintas; los repetidos se dibujarian dos veces.
+    // Se queda el primero de cada trio, en el orden original.
+    std::vector<std::pair<uint64_t, uint32_t>> keys;
+    keys.reserve(source.triangleCount());
+    for (size_t t = 0; t < source.triangleCount(); ++t) {
+        uint32_t sorted[3] = {vertexCell[t * 3], vertexCell[t * 3 + 1], vertexCell[t * 3 + 2]};
+        std::sort(sorted, sorted + 3);
+        if (sorted[0] == sorted[1] || sorted[1] == sorted[2]) {
+            continue;
+        }
+        uint64_t key = (static_cast<uint64_t>(sorted[0]) << 42) | (static_cast<uint64_t>(sorted[1]) << 21) | sorted[2];
+        keys.emplace_back(key, static_cast<uint32_t>(t));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint8_t> keep(source.triangleCount(), 0);
+    for (size_t k = 0; k < keys.size(); ++k) {
+        if (k == 0 || keys[k].first != keys[k - 1].first) {
+            keep[keys[k].second] = 1;
+        }
+    }
+
+    MeshLevel level;
+    for (size_t t = 0; t < source.triangleCount(); ++t) {
+        if (!keep[t]) {
+            continue;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t cell = vertexCell[t * 3 + k];
+            level.VBO.push_back(representative[cell]);
+            level.VBO.push_back(clusters[cell].normal);
+            level.VBO.push_back(clusters[cell].tex);
+            if (!source.tangents.empty()) {
+                level.tangents.emplace_back(clusters[cell].tangent, clusters[cell].handedness < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+    }
+    return level;
+}
+
+float pointSegmentDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b) {
+    glm::vec3 ab = b - a;
+    float t = glm::dot(ab, ab) > 0.0f ? std::clamp(glm::dot(p - a, ab) / glm::dot(ab, ab), 0.0f, 1.0f) : 0.0f;
+    return glm::length(p - (a + t * ab));
+}
+
+float pointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 n = glm::cross(b - a, c - a);
+    float area2 = glm::dot(n, n);
+    if (area2 > 0.0f) {
+        // Si la proyeccion cae dentro, la distancia es al plano
+        glm::vec3 q = p - glm::dot(p - a, n) / area2 * n;
+        float u = glm::dot(glm::cross(c - b, q - b), n);
+        float v = glm::dot(glm::cross(a - c, q - c), n);
+        float w = glm::dot(glm::cross(b - a, q - a), n);
+        if (u >= 0.0f && v >= 0.0f && w >= 0.0f) {
+            return glm::length(p - q);
+        }
+    }
+    return std::min(std::min(pointSegmentDistance(p, a, b), pointSegmentDistance(p, b, c)), pointSegmentDistance(p, c, a));
+}
+
+// Cuanto se aleja la superficie original de `level`: la distancia de cada vertice original
+// al triangulo mas cercano de level, buscando en las celdas vecinas de una grilla de `cellSize`
+float surfaceError(const MeshLevel& original, const MeshLevel& level, const glm::vec3& boundsMin,
+                   const glm::vec3& boundsMax, float cellSize) {
+    glm::ivec3 cells = glm::max(glm::ivec3(glm::ceil((boundsMax - boundsMin) / cellSize)), glm::ivec3(1));
+    auto cellCoord = [&](const glm::vec3& p) {
+        return glm::clamp(glm::ivec3(glm::floor((p - boundsMin) / cellSize)), glm::ivec3(0), cells - 1);
+    };
+    auto cellIndex = [&](const glm::ivec3& c) {
+        return static_cast<size_t>((c.z * cells.y + c.y) * cells.x + c.x);
+    };
+
+    // Triangulos de level por celda, en cada celda que toca su bounding box
+    std::vector<std::vector<uint32_t>> cellTriangles(static_cast<size_t>(cells.x) * cells.y * cells.z);
+    for (size_t t = 0; t < level.triangleCount(); ++t) {
+        const glm::vec3* v = &level.VBO[t * 9];
+        glm::ivec3 lo = cellCoord(glm::min(glm::min(v[0], v[3]), v[6]));
+        glm::ivec3 hi = cellCoord(glm::max(glm::max(v[0], v[3]), v[6]));
+        for (int z = lo.z; z <= hi.z; ++z) {
+            for (int y = lo.y; y <= hi.y; ++y) {
+                for (int x = lo.x; x <= hi.x; ++x) {
+                    cellTriangles[cellIndex(glm::ivec3(x, y, z))].push_back(static_cast<uint32_t>(t));
+                }
+            }
+        }
+    }
+
+    float error = 0.0f;
+    for (size_t i = 0; i < original.VBO.size(); i += 3) {
+        const glm::vec3& p = original.VBO[i];
+        glm::ivec3 c = cellCoord(p);
+        // Nada cerca: el error es por lo menos una celda y media
+        float distance = 1.5f * cellSize * std::sqrt(3.0f);
+        for (int z = std::max(c.z - 1, 0); z <= std::min(c.z + 1, cells.z - 1); ++z) {
+            for (int y = std::max(c.y - 1, 0); y <= std::min(c.y + 1, cells.y - 1); ++y) {
+                for (int x = std::max(c.x - 1, 0); x <= std::min(c.x + 1, cells.x - 1); ++x) {
+                    for (uint32_t t : cellTriangles[cellIndex(glm::ivec3(x, y, z))]) {
+                        const glm::vec3* v = &level.VBO[t * 9];
+                        distance = std::min(distance, pointTriangleDistance(p, v[0], v[3], v[6]));
+                    }
+                }
+            }
+        }
+        error = std::max(error, distance);
+    }
+    return error;
+}
+
+// Bounding sphere y los LODs de levels[0]
+void buildLods(Mesh& mesh) {
+    const MeshLevel& original = mesh.levels[0];
+    if (original.VBO.empty()) {
+        return;
+    }
+    glm::vec3 boundsMin = original.VBO[0];
+    glm::vec3 boundsMax = original.VBO[0];
+    for (size_t i = 0; i < original.VBO.size(); i += 3) {
+        boundsMin = glm::min(boundsMin, original.VBO[i]);
+        boundsMax = glm::max(boundsMax, original.VBO[i]);
+    }
+    mesh.center = 0.5f * (boundsMin + boundsMax);
+    mesh.radius = 0.0f;
+    for (size_t i = 0; i < original.VBO.size(); i += 3) {
+        mesh.radius = std::max(mesh.radius, glm::length(original.VBO[i] - mesh.center));
+    }
+    if (mesh.radius == 0.0f) {
+        return;
+    }
+
+    // Cada LOD sale del anterior: sus triangulos ya son mas grandes, asi una grilla gruesa
+    // todavia encuentra triangulos con tres celdas distintas
+    for (int resolution : LOD_GRID_RESOLUTIONS) {
+        MeshLevel level = clusterMesh(mesh.levels.back(), boundsMin, boundsMax, resolution);
+        if (level.triangleCount() == 0) {
+            continue;
+        }
+        if (level.triangleCount() <= LOD_MIN_REDUCTION * mesh.levels.back().triangleCount()) {
+            float cellSize = std::max(std::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y), boundsMax.z - boundsMin.z) / resolution;
+            // Nunca menos que el LOD anterior, asi selectLevel() puede parar en el primero que no sirve
+            level.error = std::max(surfaceError(mesh.levels[0], level, boundsMin, boundsMax, cellSize), mesh.levels.back().error);
+            mesh.levels.push_back(std::move(level));
+        }
+    }
+}
+
+// El LOD mas simple cuyo error no se nota con la bounding sphere de este radio en pixeles
+size_t selectLevel(const Mesh& mesh, float projectedRadius) {
+    if (mesh.radius == 0.0f) {
+        return 0;
+    }
+    float pixelsPerUnit = projectedRadius / mesh.radius;
+    size_t level = 0;
+    while (level + 1 < mesh.levels.size() && mesh.levels[level + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+        level++;
+    }
+    return level;
+}
+
+// nullptr si no se pudo leer el archivo
+std::shared_ptr<const Mesh> loadMesh(const char* path) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> texCoords;
+    std::vector<Face> faces;
+    if (!loadOBJ(path, vertices, normals, texCoords, faces)) {
+        return nullptr;
+    }
+
+    auto mesh = std::make_shared<Mesh>();
+    MeshLevel& original = mesh->levels.emplace_back();
+    original.VBO.reserve(faces.size() * 9);
+    for (const auto& face : faces) {
+        for (int i = 0; i < 3; ++i) {
+            original.VBO.push_back(vertices[face.vertexIndices[i]]);
+            original.VBO.push_back(normals[face.normalIndices[i]]);
+            original.VBO.push_back(texCoords[face.texIndices[i]]);
+        }
+    }
+    buildTangents(original, faces);
+    buildLods(*mesh);
+    return mesh;
+}
@@ -1,3 +1,5 @@
+#pragma once
+#include <memory>
 #include <vector>
 #include "uniforms.h"
 #include "fragment.h"
@@ -10,12 +12,44 @@ enum shaderType {
     ANILLOS,
     PLANETA_ANILLOS,
     SOL_AMARILLO,
+    TEXTURA,
+    TEXTURA_NORMALES,
 };
 
+// Pixeles por lado que comparten una sola invocacion del shader (modo diferido).
+// AUTO lo elige con la derivada en pantalla de originalPos.
+enum ShadingRate {
+    SHADING_RATE_AUTO = 0,
+    SHADING_RATE_1X1 = 1,
+    SHADING_RATE_2X2 = 2,
+    SHADING_RATE_4X4 = 4,
+};
+
+// Como se dibuja el modelo. Con SPHERE el mesh es una esfera alrededor de mesh.center
+// con radio mesh.radius y se dibuja con ray casting, ver sphere.h; el mesh queda para
+// cuando el ray casting esta apagado.
+enum Primitive {
+    PRIMITIVE_MESH,
+    PRIMITIVE_SPHERE,
+};
+
+// Con AUTO, tamaño maximo de un bloque de shading en espacio del objeto
+constexpr float AUTO_SHADING_BLOCK = 0.02f;
+
+struct Material;
+struct Mesh;
+
 class Model {
     public:
-        glm::mat4 modelMatrix;
-        std::vector<glm::vec3> VBO;
-        Uniforms uniforms;
-        shaderType currentShader;
+        // Nodo de la escena que da su matriz de mundo, ver scene.h
+        uint32_t node = 0;
+        // Vertices compartidos e inmutables, ver mesh.h
+        std::shared_ptr<const Mesh> mesh;
+        Primitive primitive = PRIMITIVE_MESH;
+        // Shader y sus parametros, ver material.h; se puede compartir entre modelos
+        std::shared_ptr<const Material> material;
+        ShadingRate shadingRate = SHADING_RATE_1X1;
+        // Si no esta vacio, el mesh se dibuja una vez por matriz con uniforms.model * instancia,
+        // todo en el mismo lote. No cambian despues de pipeline.start().
+        std::vector<glm::mat4> instances;
 };
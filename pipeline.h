@@ -0,0 +1,485 @@
+#pragma once
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "glm/glm.hpp"
+#include "fragment.h"
+#include "framebuffer.h"
+#include "arena.h"
+#include "impostor.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "model.h"
+#include "shaders.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "uniforms.h"
+
+// Tamaño de los rangos que se reparten entre los workers en cada etapa
+constexpr size_t INSTANCE_GRAIN = 64;
+constexpr size_t SETUP_GRAIN = 128; // triangulos
+constexpr size_t BIN_GRAIN = 256;
+constexpr size_t TILE_GRAIN = 1;
+
+// Mas de esto solo agrega latencia
+constexpr size_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// Lo que el hilo principal fija para un frame antes de soltarlo al pipeline
+struct FrameInput {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<Uniforms> uniforms; // uno por modelo
+    bool levelOfDetail = true;
+    bool impostors = true;
+    bool analyticSpheres = true; // ray casting para los modelos PRIMITIVE_SPHERE
+};
+
+// Resultado de la etapa de geometria: triangulos en pantalla ya repartidos en tiles.
+// Todo lo de tamaño variable vive en `arena`, que se resetea al empezar el frame.
+struct FrameGeometry {
+    size_t width = 0;
+    size_t height = 0;
+    size_t tilesX = 0;
+    size_t tilesY = 0;
+    std::vector<Uniforms> uniforms;
+
+    FrameArena arena;
+    // Solo los triangulos que sobrevivieron al culling
+    TriangleSetup* triangles = nullptr;
+    // Paralelo a triangles, nullptr si ningun modelo pide VARYING_TEX o VARYING_TANGENT
+    TriangleSurface* surfaces = nullptr;
+    size_t triangleCount = 0;
+    size_t submittedTriangles = 0; // antes del culling, con los LODs ya elegidos
+    // Los triangulos del tile t son binTriangles[binOffsets[t] .. binOffsets[t + 1]), en orden de envio
+    uint32_t* binOffsets = nullptr;
+    uint32_t* binTriangles = nullptr;
+    // Modelos o instancias chicos que se dibujan con su sprite, binneados igual que los triangulos
+    ImpostorDraw* impostors = nullptr;
+    size_t impostorCount = 0;
+    uint32_t* impostorBinOffsets = nullptr;
+    uint32_t* impostorBins = nullptr;
+    // Esferas con ray casting, binneadas igual
+    SphereDraw* spheres = nullptr;
+    size_t sphereCount = 0;
+    uint32_t* sphereBinOffsets = nullptr;
+    uint32_t* sphereBins = nullptr;
+    // OR de shaderVaryings() de los modelos que llegan al raster como triangulos
+    uint8_t varyings = 0;
+    float buildMs = 0.0f;
+};
+
+// Tiles que toca el bounding box de un triangulo, [x0, x1) x [y0, y1) en tiles
+// Los planos opcionales del triangulo i, nullptr si este frame no los tiene
+const TriangleSurface* triangleSurface(const FrameGeometry& geometry, size_t i) {
+    return geometry.surfaces ? geometry.surfaces + i : nullptr;
+}
+
+TileRect triangleTiles(const TriangleSetup& t) {
+    return TileRect{
+        static_cast<size_t>(t.minX) / TILE_SIZE,
+        static_cast<size_t>(t.minY) / TILE_SIZE,
+        static_cast<size_t>(t.maxX) / TILE_SIZE + 1,
+        static_cast<size_t>(t.maxY) / TILE_SIZE + 1
+    };
+}
+
+// Tiles que toca un rectangulo [x0, x1) x [y0, y1) de pixeles
+TileRect pixelTiles(const TileRect& pixels) {
+    return TileRect{
+        pixels.x0 / TILE_SIZE,
+        pixels.y0 / TILE_SIZE,
+        (pixels.x1 + TILE_SIZE - 1) / TILE_SIZE,
+        (pixels.y1 + TILE_SIZE - 1) / TILE_SIZE
+    };
+}
+
+// Binning en serie para listas cortas comparadas con los triangulos (impostores, esferas):
+// deja en bins[offsets[t] .. offsets[t + 1]) los indices de lo que toca el tile t.
+// pixelsOf(k) da el rectangulo de pixeles del elemento k.
+template <typename PixelsOf>
+void binPixelRects(FrameGeometry& geometry, size_t count, const PixelsOf& pixelsOf, uint32_t*& offsets, uint32_t*& bins) {
+    size_t tiles = geometry.tilesX * geometry.tilesY;
+    offsets = geometry.arena.allocate<uint32_t>(tiles + 1);
+    std::fill(offsets, offsets + tiles + 1, 0);
+    for (size_t k = 0; k < count; ++k) {
+        TileRect covered = pixelTiles(pixelsOf(k));
+        for (size_t ty = covered.y0; ty < covered.y1; ++ty) {
+            for (size_t tx = covered.x0; tx < covered.x1; ++tx) {
+                offsets[ty * geometry.tilesX + tx + 1]++;
+            }
+        }
+    }
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        offsets[tile + 1] += offsets[tile];
+    }
+    bins = geometry.arena.allocate<uint32_t>(offsets[tiles]);
+    uint32_t* cursors = geometry.arena.allocate<uint32_t>(tiles);
+    std::copy(offsets, offsets + tiles, cursors);
+    for (size_t k = 0; k < count; ++k) {
+        TileRect covered = pixelTiles(pixelsOf(k));
+        for (size_t ty = covered.y0; ty < covered.y1; ++ty) {
+            for (size_t tx = covered.x0; tx < covered.x1; ++tx) {
+                bins[cursors[ty * geometry.tilesX + tx]++] = static_cast<uint32_t>(k);
+            }
+        }
+    }
+}
+
+// Como se dibuja cada modelo o instancia en un frame
+enum DrawPath : uint8_t {
+    DRAW_NOTHING,   // sin mesh o fuera de pantalla
+    DRAW_TRIANGLES,
+    DRAW_IMPOSTOR,
+    DRAW_SPHERE,
+};
+
+// Bounding sphere de un mesh en pantalla
+struct ScreenSphere {
+    glm::vec3 center; // en pixeles, z como la del depth buffer
+    // En pixeles. Infinito si la camara esta dentro de la esfera o detras de su centro
+    float radius;
+};
+
+ScreenSphere projectSphere(const Mesh& mesh, const Uniforms& uniforms) {
+    glm::vec4 clip = uniforms.projection * (uniforms.view * (uniforms.model * glm::vec4(mesh.center, 1.0f)));
+    float scale = std::max(std::max(glm::length(glm::vec3(uniforms.model[0])), glm::length(glm::vec3(uniforms.model[1]))),
+                           glm::length(glm::vec3(uniforms.model[2])));
+    float radius = mesh.radius * scale;
+    if (clip.w <= radius) {
+        return ScreenSphere{glm::vec3(0.0f), std::numeric_limits<float>::infinity()};
+    }
+    glm::vec3 center = glm::vec3(uniforms.viewport * glm::vec4(glm::vec3(clip) / clip.w, 1.0f));
+    // projection[1][1] pasa de view space a NDC y viewport[1][1] de NDC a pixeles
+    return ScreenSphere{center, radius * uniforms.projection[1][1] * std::abs(uniforms.viewport[1][1]) / clip.w};
+}
+
+// Vertex shading, primitive assembly, culling y binning de un frame
+void buildGeometry(const std::vector<Model>& models, const FrameInput& input, FrameGeometry& geometry) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    geometry.arena.reset();
+    geometry.width = input.width;
+    geometry.height = input.height;
+    geometry.tilesX = (input.width + TILE_SIZE - 1) / TILE_SIZE;
+    geometry.tilesY = (input.height + TILE_SIZE - 1) / TILE_SIZE;
+    geometry.uniforms = input.uniforms;
+
+    // 1. Por cada modelo, o por cada instancia, las matrices del vertex shader y el LOD
+    // segun su tamaño en pantalla, o el setup del ray casting si es una esfera. Un modelo
+    // sin instancias cuenta como una sola.
+    size_t* firstInstance = geometry.arena.allocate<size_t>(models.size() + 1);
+    firstInstance[0] = 0;
+    for (size_t modelIndex = 0; modelIndex < models.size(); ++modelIndex) {
+        firstInstance[modelIndex + 1] = firstInstance[modelIndex] + std::max<size_t>(models[modelIndex].instances.size(), 1);
+    }
+    size_t instanceCount = firstInstance[models.size()];
+    VertexTransform* transforms = geometry.arena.allocate<VertexTransform>(instanceCount);
+    uint32_t* instanceModel = geometry.arena.allocate<uint32_t>(instanceCount);
+    DrawPath* instancePath = geometry.arena.allocate<DrawPath>(instanceCount);
+    // Solo con DRAW_TRIANGLES
+    const MeshLevel** instanceLevel = geometry.arena.allocate<const MeshLevel*>(instanceCount);
+    ScreenSphere* instanceSphere = geometry.arena.allocate<ScreenSphere>(instanceCount);
+    // Solo con DRAW_SPHERE
+    SphereDraw* sphereSetups = geometry.arena.allocate<SphereDraw>(instanceCount);
+    jobs.parallelFor(0, instanceCount, INSTANCE_GRAIN, [&](size_t begin, size_t end) {
+        size_t modelIndex = std::upper_bound(firstInstance, firstInstance + models.size() + 1, begin) - firstInstance - 1;
+        for (size_t i = begin; i < end; ++i) {
+            while (i >= firstInstance[modelIndex + 1]) {
+                modelIndex++;
+            }
+            const Model& model = models[modelIndex];
+            Uniforms uniforms = input.uniforms[modelIndex];
+            if (!model.instances.empty()) {
+                uniforms.model = uniforms.model * model.instances[i - firstInstance[modelIndex]];
+            }
+            transforms[i] = vertexTransform(uniforms);
+            instanceModel[i] = static_cast<uint32_t>(modelIndex);
+            instancePath[i] = DRAW_NOTHING;
+            instanceLevel[i] = nullptr;
+            instanceSphere[i].radius = std::numeric_limits<float>::infinity();
+            if (!model.mesh) {
+                continue;
+            }
+            // Su costo ya es proporcional a los pixeles que cubre: ni LOD ni impostor.
+            // No tiene uv, asi que un shader con textura se queda con el mesh.
+            if (input.analyticSpheres && model.primitive == PRIMITIVE_SPHERE
+                && !(shaderVaryings(model.material->shader) & VARYING_TEX)) {
+                if (setupSphere(*model.mesh, uniforms, static_cast<uint16_t>(modelIndex), input.width, input.height,
+                                sphereSetups[i])) {
+                    instancePath[i] = DRAW_SPHERE;
+                }
+                continue;
+            }
+            instanceSphere[i] = projectSphere(*model.mesh, uniforms);
+            if (input.impostors && instanceSphere[i].radius < IMPOSTOR_RADIUS) {
+                instancePath[i] = DRAW_IMPOSTOR;
+                continue;
+            }
+            size_t level = input.levelOfDetail ? selectLevel(*model.mesh, instanceSphere[i].radius) : 0;
+            instanceLevel[i] = &model.mesh->levels[level];
+            instancePath[i] = DRAW_TRIANGLES;
+        }
+    });
+
+    // Los impostores que quedan en pantalla y las esferas, compactados en orden de envio
+    size_t tiles = geometry.tilesX * geometry.tilesY;
+    geometry.impostorCount = 0;
+    geometry.sphereCount = 0;
+    geometry.varyings = 0;
+    for (size_t i = 0; i < instanceCount; ++i) {
+        geometry.impostorCount += instancePath[i] == DRAW_IMPOSTOR;
+        geometry.sphereCount += instancePath[i] == DRAW_SPHERE;
+        if (instancePath[i] == DRAW_TRIANGLES) {
+            geometry.varyings |= shaderVaryings(models[instanceModel[i]].material->shader);
+        }
+    }
+    geometry.impostors = geometry.arena.allocate<ImpostorDraw>(geometry.impostorCount);
+    geometry.spheres = geometry.arena.allocate<SphereDraw>(geometry.sphereCount);
+    geometry.impostorCount = 0;
+    geometry.sphereCount = 0;
+    for (size_t i = 0; i < instanceCount; ++i) {
+        if (instancePath[i] == DRAW_SPHERE) {
+            geometry.spheres[geometry.sphereCount++] = sphereSetups[i];
+        }
+        if (instancePath[i] != DRAW_IMPOSTOR) {
+            continue;
+        }
+        ImpostorDraw draw{instanceModel[i], static_cast<uint32_t>(i - firstInstance[instanceModel[i]]),
+                          transforms[i].model, instanceSphere[i].center, instanceSphere[i].radius};
+        TileRect pixels = impostorPixels(draw, geometry.width, geometry.height);
+        if (pixels.x0 < pixels.x1 && pixels.y0 < pixels.y1) {
+            geometry.impostors[geometry.impostorCount++] = draw;
+        }
+    }
+    binPixelRects(geometry, geometry.impostorCount, [&](size_t k) {
+        return impostorPixels(geometry.impostors[k], geometry.width, geometry.height);
+    }, geometry.impostorBinOffsets, geometry.impostorBins);
+    binPixelRects(geometry, geometry.sphereCount, [&](size_t k) {
+        return geometry.spheres[k].pixels;
+    }, geometry.sphereBinOffsets, geometry.sphereBins);
+
+    // 2. Vertex Shader + Primitive Assembly + Triangle Setup: el VBO no es indexado, asi que
+    // cada triangulo se arma directo con sus tres vertices. Los triangulos de un modelo
+    // instanciado van instancia por instancia, cada una con su LOD del mismo mesh.
+    // Cada rango escribe sus triangulos visibles en su parte del arreglo y luego se
+    // compactan, asi el orden de envio se mantiene.
+    size_t* firstTriangle = geometry.arena.allocate<size_t>(instanceCount + 1);
+    firstTriangle[0] = 0;
+    for (size_t i = 0; i < instanceCount; ++i) {
+        firstTriangle[i + 1] = firstTriangle[i] + (instanceLevel[i] ? instanceLevel[i]->triangleCount() : 0);
+    }
+    size_t submitted = firstTriangle[instanceCount];
+    geometry.submittedTriangles = submitted;
+    TriangleSetup* setups = geometry.arena.allocate<TriangleSetup>(submitted);
+    TriangleSurface* surfaces = nullptr;
+    if (geometry.varyings & (VARYING_TEX | VARYING_TANGENT)) {
+        surfaces = geometry.arena.allocate<TriangleSurface>(submitted);
+    }
+    size_t setupJobs = (submitted + SETUP_GRAIN - 1) / SETUP_GRAIN;
+    size_t* visible = geometry.arena.allocate<size_t>(setupJobs);
+    // Los planos que puede pedir el raster de este frame, sea forward o diferido
+    uint8_t* varyings = geometry.arena.allocate<uint8_t>(models.size());
+    TangentFrame* frames = geometry.arena.allocate<TangentFrame>(models.size());
+    for (size_t modelIndex = 0; modelIndex < models.size(); ++modelIndex) {
+        varyings[modelIndex] = shaderVaryings(models[modelIndex].material->shader) | GBUFFER_VARYINGS;
+        frames[modelIndex] = tangentFrame(*models[modelIndex].material);
+    }
+    jobs.parallelFor(0, submitted, SETUP_GRAIN, [&](size_t begin, size_t end) {
+        size_t count = 0;
+        size_t instance = std::upper_bound(firstTriangle, firstTriangle + instanceCount + 1, begin) - firstTriangle - 1;
+        for (size_t i = begin; i < end; ++i) {
+            while (i >= firstTriangle[instance + 1]) {
+                instance++;
+            }
+            const MeshLevel& level = *instanceLevel[instance];
+            const VertexTransform& transform = transforms[instance];
+            size_t modelIndex = instanceModel[instance];
+            size_t triangleIndex = i - firstTriangle[instance];
+            Vertex vertices[3];
+            for (size_t v = 0; v < 3; ++v) {
+                vertices[v] = vertexShader(meshVertex(level, 3 * triangleIndex + v, frames[modelIndex]), transform);
+            }
+            if (setupTriangle(vertices[0], vertices[1], vertices[2], static_cast<uint16_t>(modelIndex),
+                              varyings[modelIndex], geometry.width, geometry.height, setups[begin + count],
+                              surfaces ? surfaces + begin + count : nullptr)) {
+                count++;
+            }
+        }
+        visible[begin / SETUP_GRAIN] = count;
+    });
+    geometry.triangleCount = 0;
+    for (size_t job = 0; job < setupJobs; ++job) {
+        TriangleSetup* first = setups + job * SETUP_GRAIN;
+        if (first != setups + geometry.triangleCount) {
+            std::copy(first, first + visible[job], setups + geometry.triangleCount);
+            if (surfaces) {
+                TriangleSurface* firstSurface = surfaces + job * SETUP_GRAIN;
+                std::copy(firstSurface, firstSurface + visible[job], surfaces + geometry.triangleCount);
+            }
+        }
+        geometry.triangleCount += visible[job];
+    }
+    geometry.triangles = setups;
+    geometry.surfaces = surfaces;
+
+    // 3. Binning en dos pasadas sin locks: cada rango de triangulos cuenta en su
+    // propia columna, un prefix sum da los offsets, y cada rango escribe en su lugar.
+    size_t binJobs = std::max<size_t>((geometry.triangleCount + BIN_GRAIN - 1) / BIN_GRAIN, 1);
+    TileRect* covered = geometry.arena.allocate<TileRect>(geometry.triangleCount);
+    uint32_t* cursors = geometry.arena.allocate<uint32_t>(tiles * binJobs);
+    std::fill(cursors, cursors + tiles * binJobs, 0);
+    jobs.parallelFor(0, geometry.triangleCount, BIN_GRAIN, [&](size_t begin, size_t end) {
+        size_t job = begin / BIN_GRAIN;
+        for (size_t i = begin; i < end; ++i) {
+            covered[i] = triangleTiles(geometry.triangles[i]);
+            for (size_t ty = covered[i].y0; ty < covered[i].y1; ++ty) {
+                for (size_t tx = covered[i].x0; tx < covered[i].x1; ++tx) {
+                    cursors[(ty * geometry.tilesX + tx) * binJobs + job]++;
+                }
+            }
+        }
+    });
+
+    geometry.binOffsets = geometry.arena.allocate<uint32_t>(tiles + 1);
+    uint32_t total = 0;
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        geometry.binOffsets[tile] = total;
+        for (size_t job = 0; job < binJobs; ++job) {
+            uint32_t count = cursors[tile * binJobs + job];
+            cursors[tile * binJobs + job] = total;
+            total += count;
+        }
+    }
+    geometry.binOffsets[tiles] = total;
+
+    geometry.binTriangles = geometry.arena.allocate<uint32_t>(total);
+    jobs.parallelFor(0, geometry.triangleCount, BIN_GRAIN, [&](size_t begin, size_t end) {
+        size_t job = begin / BIN_GRAIN;
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t ty = covered[i].y0; ty < covered[i].y1; ++ty) {
+                for (size_t tx = covered[i].x0; tx < covered[i].x1; ++tx) {
+                    geometry.binTriangles[cursors[(ty * geometry.tilesX + tx) * binJobs + job]++] = static_cast<uint32_t>(i);
+                }
+            }
+        }
+    });
+    geometry.buildMs = 1000.0f * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+// Pipeline de frames: un hilo de geometria prepara el frame N+1 mientras el hilo
+// principal rasteriza y sombrea el N y el Presenter muestra el N-1. Ambas etapas
+// reparten su trabajo en el mismo job system.
+// framesInFlight es cuantos frames puede ir la geometria por delante del raster:
+// 0 es el orden serial de antes, cada uno mas agrega un frame de latencia.
+class FramePipeline {
+    public:
+        void start(const std::vector<Model>& sceneModels, size_t inFlight) {
+            models = &sceneModels;
+            framesInFlight = std::min(inFlight, MAX_FRAMES_IN_FLIGHT);
+            slots.clear();
+            slots.resize(framesInFlight + 1);
+            submitted = 0;
+            built = 0;
+            consumed = 0;
+            running = true;
+            thread = std::thread(&FramePipeline::run, this);
+        }
+
+        void stop() {
+            if (!thread.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+            }
+            submittedFrame.notify_one();
+            thread.join();
+        }
+
+        // Entrada del siguiente frame; espera a que haya un slot libre
+        FrameInput& beginFrame() {
+            std::unique_lock<std::mutex> lock(mutex);
+            releasedFrame.wait(lock, [this] { return submitted - consumed < slots.size(); });
+            return slots[submitted % slots.size()].input;
+        }
+
+        void submitFrame() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                submitted++;
+            }
+            submittedFrame.notify_one();
+        }
+
+        // Si ya hay mas frames en vuelo que la latencia pedida, el mas viejo se rasteriza ahora
+        bool rasterDue() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return submitted - consumed > framesInFlight;
+        }
+
+        // Geometria del frame en vuelo mas viejo; espera al hilo de geometria si hace falta
+        const FrameGeometry& waitGeometry() {
+            std::unique_lock<std::mutex> lock(mutex);
+            builtFrame.wait(lock, [this] { return built > consumed; });
+            return slots[consumed % slots.size()].geometry;
+        }
+
+        void releaseFrame() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                consumed++;
+            }
+            releasedFrame.notify_one();
+        }
+
+    private:
+        struct Slot {
+            FrameInput input;
+            FrameGeometry geometry;
+        };
+
+        void run() {
+            while (true) {
+                Slot* slot;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    submittedFrame.wait(lock, [this] { return built < submitted || !running; });
+                    if (!running) {
+                        break;
+                    }
+                    slot = &slots[built % slots.size()];
+                }
+
+                buildGeometry(*models, slot->input, slot->geometry);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    built++;
+                }
+                builtFrame.notify_one();
+            }
+        }
+
+        const std::vector<Model>* models = nullptr;
+        size_t framesInFlight = 0;
+        std::vector<Slot> slots;
+        // Contadores de frames: consumed <= built <= submitted
+        size_t submitted = 0;
+        size_t built = 0;
+        size_t consumed = 0;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable submittedFrame;
+        std::condition_variable builtFrame;
+        std::condition_variable releasedFrame;
+        bool running = false;
+};
+
+FramePipeline pipeline;
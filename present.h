@@ -0,0 +1,129 @@
+#pragma once
+#include <SDL.h>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "framebuffer.h"
+
+// Hilo de present: es dueño del SDL_Renderer y de una textura streaming persistente.
+// Mientras sube y presenta el frame N, el rasterizador ya dibuja el N+1 en el otro target.
+// Si el target es mas chico que la ventana (resolucion dinamica) aqui se reescala.
+class Presenter {
+    public:
+        bool start(SDL_Window* window, size_t width, size_t height) {
+            windowWidth = width;
+            windowHeight = height;
+            targets.clear();
+            targets.emplace_back(width, height);
+            targets.emplace_back(width, height);
+            scaled = allocateAligned<Uint32>(width * height);
+            back = 0;
+
+            std::promise<bool> created;
+            std::future<bool> started = created.get_future();
+            running = true;
+            thread = std::thread(&Presenter::run, this, window, std::move(created));
+            if (!started.get()) {
+                thread.join();
+                return false;
+            }
+            return true;
+        }
+
+        // Target en el que el rasterizador dibuja el siguiente frame
+        RenderTarget& backBuffer() {
+            return targets[back];
+        }
+
+        // Le pasa el back buffer al hilo de present y cambia al otro target
+        void submit() {
+            std::unique_lock<std::mutex> lock(mutex);
+            uploaded.wait(lock, [this] { return pending == nullptr; });
+            pending = &targets[back];
+            submitted.notify_one();
+            back ^= 1;
+        }
+
+        void stop() {
+            if (!thread.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+            }
+            submitted.notify_one();
+            thread.join();
+        }
+
+    private:
+        void run(SDL_Window* window, std::promise<bool> created) {
+            SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+            if (!renderer) {
+                std::cerr << "Error: Failed to create SDL renderer: " << SDL_GetError() << std::endl;
+                created.set_value(false);
+                return;
+            }
+            SDL_Texture* texture = SDL_CreateTexture(renderer, FRAMEBUFFER_FORMAT, SDL_TEXTUREACCESS_STREAMING,
+                                                     static_cast<int>(windowWidth), static_cast<int>(windowHeight));
+            if (!texture) {
+                std::cerr << "Error: Failed to create SDL texture: " << SDL_GetError() << std::endl;
+                SDL_DestroyRenderer(renderer);
+                created.set_value(false);
+                return;
+            }
+            created.set_value(true);
+
+            while (true) {
+                const RenderTarget* frame;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    submitted.wait(lock, [this] { return pending != nullptr || !running; });
+                    if (pending == nullptr) {
+                        break;
+                    }
+                    frame = pending;
+                }
+
+                if (frame->width == windowWidth && frame->height == windowHeight) {
+                    SDL_UpdateTexture(texture, NULL, frame->color.get(), static_cast<int>(windowWidth * sizeof(Uint32)));
+                } else {
+                    upscaleBilinear(*frame, scaled.get(), windowWidth, windowHeight, upscaleColumns);
+                    SDL_UpdateTexture(texture, NULL, scaled.get(), static_cast<int>(windowWidth * sizeof(Uint32)));
+                }
+
+                // El buffer ya se copio a la textura, el rasterizador lo puede reusar
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending = nullptr;
+                }
+                uploaded.notify_one();
+
+                SDL_RenderCopy(renderer, texture, NULL, NULL);
+                SDL_RenderPresent(renderer);
+            }
+
+            SDL_DestroyTexture(texture);
+            SDL_DestroyRenderer(renderer);
+        }
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable submitted;
+        std::condition_variable uploaded;
+        std::vector<RenderTarget> targets;
+        size_t back = 0;
+        size_t windowWidth = 0;
+        size_t windowHeight = 0;
+        AlignedArray<Uint32> scaled;
+        UpscaleColumns upscaleColumns;
+        const RenderTarget* pending = nullptr;
+        bool running = false;
+};
+
+void renderBuffer(Presenter& presenter) {
+    presenter.submit();
+}
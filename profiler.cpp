@@ -0,0 +1,127 @@
+#include "profiler.h"
+#include <cstdlib>
+#include <new>
+
+std::atomic<size_t> allocationCount{0};
+
+size_t allocations() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+// Reemplazos globales de operator new/delete que solo cuentan. Se reemplazan todas
+// las variantes para que ninguna llegue a la implementacion por defecto con un puntero
+// que no reservo ella.
+namespace {
+    void* countedAllocate(std::size_t size) noexcept {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+
+    void* countedAllocate(std::size_t size, std::align_val_t alignment) noexcept {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        size_t align = static_cast<size_t>(alignment);
+#if defined(_WIN32)
+        return _aligned_malloc(size ? size : 1, align);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) != 0) {
+            return nullptr;
+        }
+        return p;
+#endif
+    }
+
+    void alignedFree(void* p) noexcept {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAllocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAllocate(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(p);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Llamadas a operator new de todo el programa, en cualquier hilo (ver profiler.cpp).
+// Las llamadas de SDL a malloc no pasan por aqui.
+extern std::atomic<size_t> allocationCount;
+
+size_t allocations();
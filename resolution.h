@@ -0,0 +1,47 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Resolucion dinamica: mide el tiempo de render de los ultimos frames y escala la
+// resolucion interna para quedar dentro del presupuesto. El Presenter reescala a la ventana.
+class ResolutionController {
+    public:
+        float budgetMs = 16.6f; // 0 lo desactiva
+        float minScale = 0.25f;
+        float scale = 1.0f;
+
+        bool enabled() const {
+            return budgetMs > 0.0f;
+        }
+
+        void addFrameTime(float ms) {
+            if (!enabled()) {
+                return;
+            }
+            averageMs = averageMs == 0.0f ? ms : averageMs + (ms - averageMs) * 0.2f;
+            if (++frames < SAMPLE_FRAMES) {
+                return;
+            }
+            frames = 0;
+
+            // El costo es mas o menos proporcional a los pixeles, o sea a scale^2
+            float next = scale;
+            if (averageMs > budgetMs) {
+                next = scale * std::max(std::sqrt(budgetMs / averageMs), 0.7f);
+            } else if (averageMs < budgetMs * 0.8f) {
+                next = scale * std::min(std::sqrt(budgetMs * 0.9f / averageMs), 1.1f);
+            }
+            next = std::clamp(std::round(next * 32.0f) / 32.0f, minScale, 1.0f);
+            scale = next;
+        }
+
+        size_t scaled(size_t size) const {
+            return std::max<size_t>(1, static_cast<size_t>(std::lround(size * (enabled() ? scale : 1.0f))));
+        }
+
+    private:
+        static constexpr int SAMPLE_FRAMES = 8;
+        float averageMs = 0.0f;
+        int frames = 0;
+};
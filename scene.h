@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "jobs.h"
+
+constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+// Nodos por rango en la actualizacion paralela de un nivel
+constexpr size_t SCENE_GRAIN = 256;
+
+// Transformacion de un nodo relativa a su padre: translation * rotation * scale
+struct SceneNode {
+    uint32_t parent = NO_PARENT;
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::vec3 rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float rotation = 0.0f; // grados
+    float spin = 0.0f;     // grados que gira en cada animate()
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// translate * rotate * scale sin las dos multiplicaciones: da los mismos floats
+glm::mat4 localMatrix(const SceneNode& node) {
+    glm::mat4 local = glm::rotate(glm::mat4(1.0f), glm::radians(node.rotation), node.rotationAxis);
+    local[0] *= node.scale.x;
+    local[1] *= node.scale.y;
+    local[2] *= node.scale.z;
+    local[3] = glm::vec4(node.translation, 1.0f);
+    return local;
+}
+
+// Jerarquia de transformaciones: una luna cuelga de su planeta y el planeta de su estrella.
+// La matriz de mundo de cada nodo queda guardada y update() solo la recalcula si el nodo
+// o alguno de sus ancestros cambio. Los nodos se guardan por nivel de profundidad: dentro
+// de un nivel no dependen entre si, asi que cada nivel se reparte en el job system.
+class SceneGraph {
+    public:
+        // El padre tiene que existir ya; devuelve el indice del nodo nuevo
+        uint32_t addNode(const SceneNode& node) {
+            uint32_t index = static_cast<uint32_t>(nodes.size());
+            size_t depth = node.parent == NO_PARENT ? 0 : depths[node.parent] + 1;
+            nodes.push_back(node);
+            depths.push_back(depth);
+            world.push_back(glm::mat4(1.0f));
+            dirty.push_back(1);
+            changed.push_back(0);
+            if (levels.size() <= depth) {
+                levels.resize(depth + 1);
+            }
+            levels[depth].push_back(index);
+            return index;
+        }
+
+        const SceneNode& node(uint32_t index) const {
+            return nodes[index];
+        }
+
+        // Para cambiar un nodo; lo marca para recalcular el y todos sus descendientes
+        SceneNode& edit(uint32_t index) {
+            dirty[index] = 1;
+            return nodes[index];
+        }
+
+        // Avanza un frame la rotacion de los nodos que giran solos
+        void animate() {
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (nodes[i].spin != 0.0f) {
+                    nodes[i].rotation += nodes[i].spin;
+                    dirty[i] = 1;
+                }
+            }
+        }
+
+        // Recalcula las matrices de mundo que cambiaron, nivel por nivel desde las raices
+        void update() {
+            for (const std::vector<uint32_t>& level : levels) {
+                jobs.parallelFor(0, level.size(), SCENE_GRAIN, [&](size_t begin, size_t end) {
+                    for (size_t k = begin; k < end; ++k) {
+                        uint32_t i = level[k];
+                        uint32_t parent = nodes[i].parent;
+                        changed[i] = dirty[i] || (parent != NO_PARENT && changed[parent]);
+                        if (!changed[i]) {
+                            continue;
+                        }
+                        glm::mat4 local = localMatrix(nodes[i]);
+                        world[i] = parent == NO_PARENT ? local : world[parent] * local;
+                        dirty[i] = 0;
+                    }
+                });
+            }
+        }
+
+        // Valida despues de update()
+        const glm::mat4& worldMatrix(uint32_t index) const {
+            return world[index];
+        }
+
+        size_t size() const {
+            return nodes.size();
+        }
+
+    private:
+        std::vector<SceneNode> nodes;
+        std::vector<size_t> depths;
+        std::vector<glm::mat4> world;
+        // dirty: cambio el nodo mismo; changed: su matriz de mundo cambio en el ultimo update()
+        std::vector<uint8_t> dirty;
+        std::vector<uint8_t> changed;
+        std::vector<std::vector<uint32_t>> levels;
+};
@@ -1,26 +1,49 @@
 #pragma once
+#include <type_traits>
 #include "glm/geometric.hpp"
 #include "glm/glm.hpp"
 #include "uniforms.h"
 #include "fragment.h"
 #include "noise.h"
 #include "print.h"
+#include "mesh.h"
+#include "model.h"
+#include "material.h"
+#include "triangle.h"
+
+// Las matrices que usa el vertex shader, armadas una vez por modelo o por instancia
+// en vez de multiplicar projection * view * model en cada vertice
+struct VertexTransform {
+    glm::mat4 modelViewProjection;
+    glm::mat4 model;
+    glm::mat3 normal;
+    glm::mat4 viewport;
+};
+
+VertexTransform vertexTransform(const Uniforms& uniforms) {
+    return VertexTransform{
+        uniforms.projection * uniforms.view * uniforms.model,
+        uniforms.model,
+        glm::mat3(uniforms.model),
+        uniforms.viewport
+    };
+}
 
-Vertex vertexShader(const Vertex& vertex, const Uniforms& uniforms) {
+Vertex vertexShader(const Vertex& vertex, const VertexTransform& transform) {
     // Apply transformations to the input vertex using the matrices from the uniforms
-    glm::vec4 clipSpaceVertex = uniforms.projection * uniforms.view * uniforms.model * glm::vec4(vertex.position, 1.0f);
+    glm::vec4 clipSpaceVertex = transform.modelViewProjection * glm::vec4(vertex.position, 1.0f);
 
     // Perspective divide
     glm::vec3 ndcVertex = glm::vec3(clipSpaceVertex) / clipSpaceVertex.w;
 
     // Apply the viewport transform
-    glm::vec4 screenVertex = uniforms.viewport * glm::vec4(ndcVertex, 1.0f);
+    glm::vec4 screenVertex = transform.viewport * glm::vec4(ndcVertex, 1.0f);
     
     // Transform the normal
-    glm::vec3 transformedNormal = glm::mat3(uniforms.model) * vertex.normal;
+    glm::vec3 transformedNormal = transform.normal * vertex.normal;
     transformedNormal = glm::normalize(transformedNormal);
 
-    glm::vec3 transformedWorldPosition = glm::vec3(uniforms.model * glm::vec4(vertex.position, 1.0f));
+    glm::vec3 transformedWorldPosition = glm::vec3(transform.model * glm::vec4(vertex.position, 1.0f));
 
     // Return the transformed vertex as a vec3
     return Vertex{
@@ -28,10 +51,39 @@ Vertex vertexShader(const Vertex& vertex, const Uniforms& uniforms) {
         transformedNormal,
         vertex.tex,
         transformedWorldPosition,
-        vertex.position
+        vertex.position,
+        1.0f / clipSpaceVertex.w,
+        transform.normal * vertex.tangent,
+        transform.normal * vertex.bitangent
     };
 }
 
+// De donde sale el marco tangente de un vertice: ninguno si el shader no lee normal map,
+// el del mesh, o los ejes del objeto si el mapa ya esta en espacio del objeto. Asi el
+// shader arma la normal igual en los dos casos.
+enum TangentFrame {
+    TANGENT_FRAME_NONE,
+    TANGENT_FRAME_MESH,
+    TANGENT_FRAME_OBJECT,
+};
+
+// Vertice `index` de un nivel, antes del vertex shader
+Vertex meshVertex(const MeshLevel& level, size_t index, TangentFrame frame) {
+    Vertex vertex{};
+    vertex.position = level.VBO[index * 3];
+    vertex.normal = level.VBO[index * 3 + 1];
+    vertex.tex = level.VBO[index * 3 + 2];
+    if (frame == TANGENT_FRAME_MESH) {
+        glm::vec4 tangent = level.tangents[index];
+        vertex.tangent = glm::vec3(tangent);
+        vertex.bitangent = tangent.w * glm::cross(glm::normalize(vertex.normal), vertex.tangent);
+    } else if (frame == TANGENT_FRAME_OBJECT) {
+        vertex.tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+        vertex.bitangent = glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    return vertex;
+}
+
 // Helper to convert HSV to RGB
 glm::vec3 hsv2rgb(glm::vec3 c) {
 
@@ -47,26 +99,16 @@ glm::vec3 hsv2rgb(glm::vec3 c) {
 }
 
 // Shader fragment function
-Fragment sol(Fragment& fragment) {
+Fragment sol(Fragment& fragment, const Material& material) {
 
     // Get UV coordinates
     glm::vec2 uv = glm::vec2(fragment.originalPos.x, fragment.originalPos.y / fragment.originalPos.z + 0.5f);
-    // glm::vec2 uv = glm::vec2(fragment.originalPos.x, fragment.originalPos.y);
-    // uv = uv * fragment.originalPos.x;
 
     // Generate Perlin noise
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
-
-    float offsetX = 10000.0f;
-    float offsetY = 10000.0f;
-    float scale = 9000.0f;
-
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale,
-                                               (uv.y + offsetY) * scale);
+    float noiseValue = material.noise[0].sample(uv);
 
-    // Map noise range [-1, 1] to hue shift [0, 0.1]
-    float hueShift = noiseValue * 0.1f;
+    // Map noise range [-1, 1] to hue shift [0, amplitude]
+    float hueShift = noiseValue * material.amplitude;
 
     // Create HSV color with shifted hue
     glm::vec3 hsv = glm::vec3(hueShift, 1.0f, 1.0f);
@@ -80,27 +122,16 @@ Fragment sol(Fragment& fragment) {
     return fragment;
 }
 
-Fragment solAmarillo(Fragment& fragment) {
-    glm::vec3 sunColor1 = glm::vec3(252.0f / 255.0f, 211.0f / 255.0f, 0.0f / 255.0f);
-    glm::vec3 sunColor2 = glm::vec3(252.0f / 255.0f, 163.0f / 255.0f, 0.0f / 255.0f);
-
+Fragment solAmarillo(Fragment& fragment, const Material& material) {
     // Sample the Perlin noise map at the fragment's position
-    glm::vec2 uv = glm::vec2(fragment.originalPos.x, fragment.originalPos.y * 5.0f);
-
-    // Set up the noise generator
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
-
-    float offsetX = 10000.0f;
-    float offsetY = 10000.0f;
-    float scale = 9000.0f;
+    glm::vec2 uv = glm::vec2(fragment.originalPos.x, fragment.originalPos.y * material.frequency);
 
     // Generate the noise value
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale, (uv.y + offsetY) * scale);
+    float noiseValue = material.noise[0].sample(uv);
 
-    // Map the noise value to a smooth gradient between sunColor1 and sunColor2
+    // Map the noise value to a smooth gradient between the two sun colors
     float t = glm::smoothstep(-1.0f, 1.0f, noiseValue); // Map [-1, 1] to [0, 1]
-    glm::vec3 finalColor = glm::mix(sunColor1, sunColor2, t);
+    glm::vec3 finalColor = glm::mix(material.colors[0], material.colors[1], t);
 
     // Convert glm::vec3 color to your Color class
     fragment.color = Color(finalColor.r, finalColor.g, finalColor.b);
@@ -108,33 +139,18 @@ Fragment solAmarillo(Fragment& fragment) {
     return fragment;
 }
 
-Fragment tierra(Fragment& fragment) {
+Fragment tierra(Fragment& fragment, const Material& material) {
     Color color;
 
-    glm::vec3 groundColor = glm::vec3(0.44f, 0.51f, 0.33f);
-    glm::vec3 groudColor2 = glm::vec3(0.97f, 0.53f, 0.18f);
-    glm::vec3 oceanColor = glm::vec3(0.12f, 0.38f, 0.57f);
-    glm::vec3 cloudColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    const glm::vec3& groundColor = material.colors[0];
+    const glm::vec3& groudColor2 = material.colors[1];
+    const glm::vec3& oceanColor = material.colors[2];
+    const glm::vec3& cloudColor = material.colors[3];
 
     glm::vec2 uv = glm::vec2(fragment.originalPos.x, fragment.originalPos.y);
 
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
-
-    FastNoiseLite noiseGenerator2;
-    noiseGenerator2.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
-
-    float ox = 1200.0f;
-    float oy = 3000.0f;
-    float zoom = 400.0f;
-
-    float noiseValue = noiseGenerator.GetNoise((uv.x + ox) * zoom, (uv.y + oy) * zoom);
-
-    float oxg = 5500.0f;
-    float oyg = 6900.0f;
-    float zoomg = 900.0f;
-
-    float noiseValueG = noiseGenerator2.GetNoise((uv.x + oxg) * zoomg, (uv.y + oyg) * zoomg);
+    float noiseValue = material.noise[0].sample(uv);
+    float noiseValueG = material.noise[1].sample(uv);
 
     glm::vec3 tmpColor;
     if (noiseValue < 0.5f) {
@@ -147,11 +163,7 @@ Fragment tierra(Fragment& fragment) {
         }
     }
 
-    float oxc = 5500.0f;
-    float oyc = 6900.0f;
-    float zoomc = 300.0f;
-
-    float noiseValueC = noiseGenerator.GetNoise((uv.x + oxc) * zoomc, (uv.y + oyc) * zoomc);
+    float noiseValueC = material.noise[2].sample(uv);
 
     if (noiseValueC > 0.5f) {
         float t = (noiseValueC - 0.5f) * 2.0f; // Map [-1, 1] to [0, 1]
@@ -165,34 +177,16 @@ Fragment tierra(Fragment& fragment) {
     return fragment;
 }
 
-Fragment gaseoso(Fragment& fragment) {
+Fragment gaseoso(Fragment& fragment, const Material& material) {
     Color color;
 
-    glm::vec3 mainColor = glm::vec3(163.0f/255.0f, 135.0f/255.0f, 115.0f/255.0f);
-    glm::vec3 secondColor = glm::vec3(248.0f/255.0f, 213.0f/255.0f, 183.0f/255.0f);
-
     glm::vec2 uv = glm::vec2(fragment.originalPos.x * 2.0 - 1.0 , fragment.originalPos.y * 2.0 - 1.0);
 
-    // Frecuencia y amplitud de las ondas en el planeta
-    float frequency = 15.0; // Ajusta la frecuencia de las líneas
-    float amplitude = 0.1; // Ajusta la amplitud de las líneas
-
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Cellular);
-
-    float offsetX = 10000.0f;
-    float offsetY = 10000.0f;
-    float scale = 900.0f;
-
-    // Genera el valor de ruido
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale, (uv.y + offsetY) * scale);
-    noiseValue = (noiseValue + 1.0f) * 0.5f; // Map [-1, 1] to [0, 1]
-
     // Calcula el valor sinusoide para crear líneas
-    float sinValue = glm::sin(uv.y * frequency) * amplitude;
+    float sinValue = glm::sin(uv.y * material.frequency) * material.amplitude;
 
     // Combina el color base con las líneas sinusoide
-    secondColor = mainColor + glm::vec3 (sinValue);
+    glm::vec3 secondColor = material.colors[0] + glm::vec3 (sinValue);
 
     color = Color(secondColor.x, secondColor.y, secondColor.z);
 
@@ -201,29 +195,17 @@ Fragment gaseoso(Fragment& fragment) {
     return fragment;
 }
 
-Fragment luna(Fragment& fragment) {
+Fragment luna(Fragment& fragment, const Material& material) {
     Color color;
 
-    glm::vec3 moonColor = glm::vec3(0.8f, 0.8f, 0.8f); // Color de la luna
-
     glm::vec2 uv = glm::vec2(fragment.originalPos.x * 2.0 - 1.0, fragment.originalPos.y * 2.0 - 1.0);
 
-    // Frecuencia y amplitud de las texturas para simular la superficie rugosa
-    float amplitude = 0.1; // Ajusta la amplitud de las texturas
-
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
-
-    float offsetX = 5000.0f;
-    float offsetY = 8000.0f;
-    float scale = 500.0f;
-
     // Genera el valor de ruido para la superficie rugosa
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale, (uv.y + offsetY) * scale);
+    float noiseValue = material.noise[0].sample(uv);
     noiseValue = (noiseValue + 1.0f) * 0.5f; // Mapea [-1, 1] a [0, 1]
 
     // Combina el color de la luna con las texturas rugosas
-    moonColor = glm::mix(moonColor, glm::vec3(0.6f, 0.6f, 0.6f), noiseValue * amplitude * 5.0f);
+    glm::vec3 moonColor = glm::mix(material.colors[0], material.colors[1], noiseValue * material.amplitude * 5.0f);
 
     color = Color(moonColor.x, moonColor.y, moonColor.z);
 
@@ -232,30 +214,17 @@ Fragment luna(Fragment& fragment) {
     return fragment;
 }
 
-Fragment anillos(Fragment& fragment) {
+Fragment anillos(Fragment& fragment, const Material& material) {
     Color color;
-    glm::vec3 mainColor = glm::vec3 (0.0f, 188.0f/ 255.0f, 159.0f/255.0f);
-    glm::vec3 secondColor = glm::vec3(51.0f, 108.0f/ 255.0f, 99.0f/255.0f);
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
 
     glm::vec3 uv = glm::vec3(fragment.originalPos.x * 2.0 - 1.0,
                              fragment.originalPos.y * 2.0 - 1.0,
                              fragment.originalPos.z);
 
-    // Frecuencia y amplitud de las texturas para simular la superficie rugosa
-    float amplitude = 0.1; // Ajusta la amplitud de las texturas
-
-    float offsetX = 5000.0f;
-    float offsetY = 8000.0f;
-    float offsetZ = 300.0f;
-    float scale = 500.0f;
-
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale, (uv.y + offsetY) * scale, (uv.z + offsetZ) * scale);
+    float noiseValue = material.noise[0].sample(uv);
     noiseValue = (noiseValue + 1.0f) * 0.5f; // Mapea [-1, 1] a [0, 1]
 
-    mainColor = glm::mix(mainColor, secondColor, noiseValue * amplitude * 5.0f);
-
+    glm::vec3 mainColor = glm::mix(material.colors[0], material.colors[1], noiseValue * material.amplitude * 5.0f);
 
     color = Color(mainColor.x, mainColor.y, mainColor.z);
 
@@ -268,34 +237,16 @@ Fragment anillos(Fragment& fragment) {
     return fragment;
 }
 
-Fragment platenaAnillos(Fragment& fragment) {
+Fragment platenaAnillos(Fragment& fragment, const Material& material) {
     Color color;
 
-    glm::vec3 mainColor = glm::vec3 (0.0f, 188.0f/ 255.0f, 159.0f/255.0f);
-    glm::vec3 secondColor = glm::vec3(51.0f, 108.0f/ 255.0f, 99.0f/255.0f);
-
     glm::vec2 uv = glm::vec2(fragment.originalPos.x * 2.0 - 1.0 , fragment.originalPos.y * 2.0 - 1.0);
 
-    // Frecuencia y amplitud de las ondas en el planeta
-    float frequency = 15.0; // Ajusta la frecuencia de las líneas
-    float amplitude = 0.1; // Ajusta la amplitud de las líneas
-
-    FastNoiseLite noiseGenerator;
-    noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Cellular);
-
-    float offsetX = 10000.0f;
-    float offsetY = 10000.0f;
-    float scale = 900.0f;
-
-    // Genera el valor de ruido
-    float noiseValue = noiseGenerator.GetNoise((uv.x + offsetX) * scale, (uv.y + offsetY) * scale);
-    noiseValue = (noiseValue + 1.0f) * 0.5f; // Map [-1, 1] to [0, 1]
-
     // Calcula el valor sinusoide para crear líneas
-    float sinValue = glm::sin(uv.y * frequency) * amplitude;
+    float sinValue = glm::sin(uv.y * material.frequency) * material.amplitude;
 
     // Combina el color base con las líneas sinusoide
-    secondColor = mainColor + glm::vec3 (sinValue);
+    glm::vec3 secondColor = material.colors[0] + glm::vec3 (sinValue);
 
     color = Color(secondColor.x, secondColor.y, secondColor.z);
 
@@ -306,4 +257,132 @@ Fragment platenaAnillos(Fragment& fragment) {
     fragment.color = color * fragment.intensity;
 
     return fragment;
-}
\ No newline at end of file
+}
+
+// Color de la textura del material con filtrado trilineal, iluminado como los demas
+Fragment textura(Fragment& fragment, const Material& material) {
+    glm::vec4 albedo = sampleTrilinear(*material.texture, fragment.tex, fragment.texDx, fragment.texDy);
+
+    fragment.color = Color(albedo.r, albedo.g, albedo.b) * fragment.intensity;
+
+    return fragment;
+}
+
+// Largo minimo de la normal decodificada de un normal map para usarla
+constexpr float NORMAL_MAP_MIN_LENGTH = 0.05f;
+
+// textura() con la normal de material.normalMap en vez de la interpolada: el detalle de un
+// modelo de muchos triangulos sobre uno de pocos. tangent y bitangent son los ejes x e y
+// del mapa; el z es la normal del mesh, o tangent x bitangent con un mapa en espacio del objeto.
+// Un mip que promedia normales opuestas (gris, ~0 al decodificar) no tiene direccion: ahi
+// queda la normal del mesh.
+Fragment texturaNormales(Fragment& fragment, const Material& material) {
+    glm::vec4 albedo = sampleTrilinear(*material.texture, fragment.tex, fragment.texDx, fragment.texDy);
+    glm::vec3 mapped = glm::vec3(sampleTrilinear(*material.normalMap, fragment.tex, fragment.texDx, fragment.texDy)) * 2.0f - 1.0f;
+
+    glm::vec3 tangent = glm::normalize(fragment.tangent);
+    glm::vec3 bitangent = glm::normalize(fragment.bitangent);
+    glm::vec3 axis = material.normalSpace == NORMAL_MAP_OBJECT ? glm::cross(tangent, bitangent) : fragment.normal;
+    glm::vec3 normal = tangent * mapped.x + bitangent * mapped.y + axis * mapped.z;
+    float length = glm::length(normal);
+    normal = length > NORMAL_MAP_MIN_LENGTH ? normal / length : fragment.normal;
+    float intensity = std::max(glm::dot(normal, L), 0.0f);
+
+    fragment.color = Color(albedo.r, albedo.g, albedo.b) * intensity;
+
+    return fragment;
+}
+
+// Cada shader en compile time: que campos del Fragment lee (Varying) y su funcion.
+// Cada shader nuevo tiene que declarar el suyo.
+template <shaderType Shader>
+struct ShaderTraits;
+
+template <> struct ShaderTraits<SOL> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return sol(fragment, material); }
+};
+template <> struct ShaderTraits<TIERRA> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return tierra(fragment, material); }
+};
+template <> struct ShaderTraits<GASEOSO> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return gaseoso(fragment, material); }
+};
+template <> struct ShaderTraits<LUNA> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return luna(fragment, material); }
+};
+template <> struct ShaderTraits<ANILLOS> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return anillos(fragment, material); }
+};
+template <> struct ShaderTraits<PLANETA_ANILLOS> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return platenaAnillos(fragment, material); }
+};
+template <> struct ShaderTraits<SOL_AMARILLO> {
+    static constexpr uint8_t varyings = VARYING_ORIGINAL_POS;
+    static Fragment shade(Fragment& fragment, const Material& material) { return solAmarillo(fragment, material); }
+};
+
+template <> struct ShaderTraits<TEXTURA> {
+    static constexpr uint8_t varyings = VARYING_TEX;
+    static Fragment shade(Fragment& fragment, const Material& material) { return textura(fragment, material); }
+};
+template <> struct ShaderTraits<TEXTURA_NORMALES> {
+    static constexpr uint8_t varyings = VARYING_TEX | VARYING_NORMAL | VARYING_TANGENT;
+    static Fragment shade(Fragment& fragment, const Material& material) { return texturaNormales(fragment, material); }
+};
+
+// Llama a f(std::integral_constant<shaderType, shader>{}): un solo switch, y dentro de f
+// el shader se conoce en tiempo de compilacion
+template <typename F>
+void withShader(shaderType shader, const F& f) {
+    switch (shader) {
+        case SOL:
+            f(std::integral_constant<shaderType, SOL>{});
+            break;
+        case TIERRA:
+            f(std::integral_constant<shaderType, TIERRA>{});
+            break;
+        case GASEOSO:
+            f(std::integral_constant<shaderType, GASEOSO>{});
+            break;
+        case LUNA:
+            f(std::integral_constant<shaderType, LUNA>{});
+            break;
+        case ANILLOS:
+            f(std::integral_constant<shaderType, ANILLOS>{});
+            break;
+        case PLANETA_ANILLOS:
+            f(std::integral_constant<shaderType, PLANETA_ANILLOS>{});
+            break;
+        case SOL_AMARILLO:
+            f(std::integral_constant<shaderType, SOL_AMARILLO>{});
+            break;
+        case TEXTURA:
+            f(std::integral_constant<shaderType, TEXTURA>{});
+            break;
+        case TEXTURA_NORMALES:
+            f(std::integral_constant<shaderType, TEXTURA_NORMALES>{});
+            break;
+    }
+}
+
+// Los varyings en runtime, para la etapa de geometria
+uint8_t shaderVaryings(shaderType shader) {
+    uint8_t varyings = VARYING_WORLD_POS | VARYING_ORIGINAL_POS | VARYING_NORMAL;
+    withShader(shader, [&](auto s) {
+        varyings = ShaderTraits<decltype(s)::value>::varyings;
+    });
+    return varyings;
+}
+
+TangentFrame tangentFrame(const Material& material) {
+    if (!(shaderVaryings(material.shader) & VARYING_TANGENT)) {
+        return TANGENT_FRAME_NONE;
+    }
+    return material.normalSpace == NORMAL_MAP_OBJECT ? TANGENT_FRAME_OBJECT : TANGENT_FRAME_MESH;
+}
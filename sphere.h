@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "fragment.h"
+#include "framebuffer.h"
+#include "mesh.h"
+#include "shaders.h"
+#include "triangle.h"
+#include "uniforms.h"
+
+// Una esfera que se dibuja con ray casting, armada en la etapa de geometria. El rayo de
+// cada pixel se intersecta con la esfera en espacio del objeto, asi el punto de impacto
+// ya es originalPos y su normal es exacta: no hay vertices ni nada que interpolar.
+struct SphereDraw {
+    glm::mat4 screenToObject; // inversa de viewport * projection * view * model
+    glm::vec3 eye;            // la camara en espacio del objeto
+    glm::vec3 center;         // en espacio del objeto
+    float radius;
+    VertexTransform transform; // para el depth, worldPos y la normal del punto de impacto
+    TileRect pixels;           // el cuadrado que cubre en pantalla, [x0, x1) x [y0, y1), ya recortado
+    uint16_t model;
+};
+
+// Pendientes a / depth de los dos planos que pasan por la camara y son tangentes a la
+// esfera, sobre un eje de la pantalla. `a` es la coordenada del centro en view space en
+// ese eje y depth la distancia delante de la camara; necesita depth > radius.
+void tangentSlopes(float a, float depth, float radius, float& low, float& high) {
+    float tangent = std::sqrt(a * a + depth * depth - radius * radius);
+    float denominator = depth * depth - radius * radius;
+    low = (a * depth - radius * tangent) / denominator;
+    high = (a * depth + radius * tangent) / denominator;
+}
+
+// Arma el registro de ray casting de la esfera de `mesh`. Falso si no cubre ningun pixel de un
+// target de width x height. Los limites son exactos para una perspectiva sin skew.
+bool setupSphere(const Mesh& mesh, const Uniforms& uniforms, uint16_t model, size_t width, size_t height, SphereDraw& s) {
+    glm::mat4 modelView = uniforms.view * uniforms.model;
+    float scale = std::max(std::max(glm::length(glm::vec3(uniforms.model[0])), glm::length(glm::vec3(uniforms.model[1]))),
+                           glm::length(glm::vec3(uniforms.model[2])));
+    glm::vec3 center = glm::vec3(modelView * glm::vec4(mesh.center, 1.0f));
+    float radius = mesh.radius * scale;
+    float depth = -center.z;
+    if (depth <= -radius) {
+        return false; // toda detras de la camara
+    }
+
+    // Si la esfera cruza el plano de la camara su proyeccion no es acotada: toda la pantalla
+    float minX = 0.0f;
+    float minY = 0.0f;
+    float maxX = width - 1.0f;
+    float maxY = height - 1.0f;
+    if (depth > radius) {
+        float low, high;
+        tangentSlopes(center.x, depth, radius, low, high);
+        float x0 = uniforms.viewport[0][0] * uniforms.projection[0][0] * low + uniforms.viewport[3][0];
+        float x1 = uniforms.viewport[0][0] * uniforms.projection[0][0] * high + uniforms.viewport[3][0];
+        tangentSlopes(center.y, depth, radius, low, high);
+        float y0 = uniforms.viewport[1][1] * uniforms.projection[1][1] * low + uniforms.viewport[3][1];
+        float y1 = uniforms.viewport[1][1] * uniforms.projection[1][1] * high + uniforms.viewport[3][1];
+        // Un pixel de margen: el borde exacto y el rayo de cada pixel no redondean igual
+        minX = std::max(minX, std::floor(std::min(x0, x1)));
+        minY = std::max(minY, std::floor(std::min(y0, y1)));
+        maxX = std::min(maxX, std::ceil(std::max(x0, x1)));
+        maxY = std::min(maxY, std::ceil(std::max(y0, y1)));
+    }
+    if (!(minX <= maxX && minY <= maxY)) {
+        return false;
+    }
+    s.pixels = TileRect{static_cast<size_t>(minX), static_cast<size_t>(minY), static_cast<size_t>(maxX) + 1,
+                        static_cast<size_t>(maxY) + 1};
+
+    // En double: viewport * projection mezcla escalas de cientos de pixeles con el near plane
+    glm::dmat4 toScreen = glm::dmat4(uniforms.viewport) * glm::dmat4(uniforms.projection) * glm::dmat4(modelView);
+    s.screenToObject = glm::mat4(glm::inverse(toScreen));
+    s.eye = glm::vec3(glm::inverse(glm::dmat4(modelView))[3]);
+    s.center = mesh.center;
+    s.radius = mesh.radius;
+    s.transform = vertexTransform(uniforms);
+    s.model = model;
+    return true;
+}
+
+// Ray casting de los pixeles de `s` dentro de `rect`, con la misma salida que triangle(): el
+// fragmento va a emit(const RasterFragment<Varyings>&). Los pixeles se muestrean en coordenadas
+// enteras como en el rasterizador, y tambien se salta el lado opuesto a L.
+template <uint8_t Varyings, typename Emit>
+void sphere(const SphereDraw& s, const TileRect& rect, const Emit& emit) {
+    using Output = RasterFragment<Varyings>;
+    size_t startX = std::max(s.pixels.x0, rect.x0);
+    size_t startY = std::max(s.pixels.y0, rect.y0);
+    size_t endX = std::min(s.pixels.x1, rect.x1);
+    size_t endY = std::min(s.pixels.y1, rect.y1);
+    glm::vec3 offset = s.eye - s.center;
+    float c = glm::dot(offset, offset) - s.radius * s.radius;
+
+    for (size_t y = startY; y < endY; ++y) {
+        glm::vec4 row = s.screenToObject[1] * static_cast<float>(y) + s.screenToObject[3];
+        for (size_t x = startX; x < endX; ++x) {
+            // Un punto del rayo en z = 0 de pantalla; la direccion sale de la camara hacia el
+            glm::vec4 point = s.screenToObject[0] * static_cast<float>(x) + row;
+            glm::vec3 direction = glm::normalize(glm::vec3(point) / point.w - s.eye);
+            float b = glm::dot(offset, direction);
+            float discriminant = b * b - c;
+            if (discriminant < 0.0f) {
+                continue;
+            }
+            float root = std::sqrt(discriminant);
+            float t = -b - root;
+            if (t <= 0.0f) {
+                t = -b + root; // camara dentro de la esfera
+            }
+            if (t <= 0.0f) {
+                continue;
+            }
+            glm::vec3 hit = s.eye + t * direction;
+
+            glm::vec3 normal = glm::normalize(s.transform.normal * (hit - s.center));
+            float intensity = glm::dot(normal, L);
+            if (intensity < 0) {
+                continue;
+            }
+
+            glm::vec4 clip = s.transform.modelViewProjection * glm::vec4(hit, 1.0f);
+            Output fragment;
+            fragment.x = static_cast<uint16_t>(x);
+            fragment.y = static_cast<uint16_t>(y);
+            fragment.z = (s.transform.viewport * glm::vec4(glm::vec3(clip) / clip.w, 1.0f)).z;
+            fragment.intensity = intensity;
+            if constexpr (Output::hasWorldPos) {
+                fragment.worldPos = glm::vec3(s.transform.model * glm::vec4(hit, 1.0f));
+            }
+            if constexpr (Output::hasOriginalPos) {
+                fragment.originalPos = hit;
+            }
+            if constexpr (Output::hasNormal) {
+                fragment.normal = normal;
+            }
+            if constexpr (Output::hasTex) {
+                // La esfera no tiene uv: los modelos con textura se dibujan con su mesh
+                fragment.tex = glm::vec2(0.0f);
+                fragment.texDx = glm::vec2(0.0f);
+                fragment.texDy = glm::vec2(0.0f);
+            }
+            if constexpr (Output::hasTangent) {
+                fragment.tangent = glm::vec3(0.0f);
+                fragment.bitangent = glm::vec3(0.0f);
+            }
+            emit(fragment);
+        }
+    }
+}
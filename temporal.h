@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "fragment.h"
+#include "framebuffer.h"
+#include "uniforms.h"
+
+// Lo que quedo en un pixel el frame anterior
+struct HistoryTexel {
+  glm::vec3 originalPos; // punto donde realmente se evaluo el shader de este color
+  float intensity;       // luz con la que se sombreo
+  Uint32 color;
+  uint16_t model;        // NO_MODEL si el pixel quedo vacio
+};
+
+HistoryTexel emptyHistory{
+  glm::vec3(0.0f),
+  0.0f,
+  0,
+  NO_MODEL
+};
+
+// Reuso temporal para cuerpos que solo rotan: un pixel cuyo punto del objeto ya estaba
+// visible el frame anterior reusa ese color en vez de volver a correr el shader.
+// Los colores reusados guardan el punto y la luz con que se sombrearon, asi el error
+// no se acumula mas alla de las tolerancias, y 1 de cada REFRESH_PERIOD pixeles se
+// vuelve a sombrear cada frame.
+class TemporalHistory {
+    public:
+        static constexpr uint32_t REFRESH_PERIOD = 8;
+
+        // Distancia maxima entre el punto del pixel y el que se sombreo, en pixeles
+        float footprintTolerance = 1.0f;
+        float intensityTolerance = 0.02f;
+
+        size_t width = 0;
+        size_t height = 0;
+        size_t tilesX = 0;
+        std::vector<HistoryTexel> texels[2];
+        // Tiles escritos en ese frame; el resto cuenta como vacio
+        std::vector<uint8_t> tileValid[2];
+        // viewport * projection * view * model de cada modelo
+        std::vector<glm::mat4> transforms[2];
+        size_t current = 0;
+        uint32_t frame = 0;
+
+        // Los tiles se sombrean en paralelo, ver shadeGBuffer
+        std::atomic<size_t> reused{0};
+        std::atomic<size_t> shaded{0};
+};
+
+void beginHistoryFrame(TemporalHistory& history, const RenderTarget& target, const std::vector<Uniforms>& uniforms) {
+    if (history.width != target.width || history.height != target.height) {
+        history.width = target.width;
+        history.height = target.height;
+        history.tilesX = target.tilesX;
+        for (size_t i = 0; i < 2; ++i) {
+            history.texels[i].assign(target.width * target.height, emptyHistory);
+            history.tileValid[i].assign(tileCount(target), 0);
+        }
+    }
+    history.current ^= 1;
+    std::fill(history.tileValid[history.current].begin(), history.tileValid[history.current].end(), 0);
+    std::vector<glm::mat4>& transforms = history.transforms[history.current];
+    transforms.resize(uniforms.size());
+    for (size_t i = 0; i < uniforms.size(); ++i) {
+        const Uniforms& u = uniforms[i];
+        transforms[i] = u.viewport * u.projection * u.view * u.model;
+    }
+    history.frame++;
+    history.reused = 0;
+    history.shaded = 0;
+}
+
+// Pixeles que se sombrean si o si este frame, rotando por un patron de 4x2
+bool needsRefresh(const TemporalHistory& history, size_t x, size_t y) {
+    return ((x & 3) | ((y & 1) << 2)) == history.frame % TemporalHistory::REFRESH_PERIOD;
+}
+
+// Busca el punto en espacio del objeto en la imagen del frame anterior, con su transformacion
+bool reproject(const TemporalHistory& history, const glm::vec3& originalPos, float intensity, float footprint,
+               uint16_t model, HistoryTexel& out) {
+    size_t previous = history.current ^ 1;
+    if (model >= history.transforms[previous].size()) {
+        return false;
+    }
+    glm::vec4 clip = history.transforms[previous][model] * glm::vec4(originalPos, 1.0f);
+    if (clip.w <= 0.0f) {
+        return false;
+    }
+    int x = static_cast<int>(std::round(clip.x / clip.w));
+    int y = static_cast<int>(std::round(clip.y / clip.w));
+    if (x < 0 || y < 0 || x >= static_cast<int>(history.width) || y >= static_cast<int>(history.height)) {
+        return false;
+    }
+    if (!history.tileValid[previous][(y / TILE_SIZE) * history.tilesX + x / TILE_SIZE]) {
+        return false;
+    }
+
+    const HistoryTexel& texel = history.texels[previous][y * history.width + x];
+    // Disoclusion: en ese pixel se veia otra cosa
+    if (texel.model != model
+        || glm::length(texel.originalPos - originalPos) > footprint * history.footprintTolerance
+        || std::abs(texel.intensity - intensity) > history.intensityTolerance) {
+        return false;
+    }
+    out = texel;
+    return true;
+}
+
+void recordHistory(TemporalHistory& history, size_t x, size_t y, const HistoryTexel& texel) {
+    history.texels[history.current][y * history.width + x] = texel;
+    history.tileValid[history.current][(y / TILE_SIZE) * history.tilesX + x / TILE_SIZE] = 1;
+}
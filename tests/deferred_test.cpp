@@ -0,0 +1,157 @@
+// Un modelo con normal map sombreado en forward y desde el G-buffer: los dos caminos tienen que
+// dar la misma imagen. Uso: deferred_test <directorio con diablo3.obj y sus texturas>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "../glm/gtc/matrix_transform.hpp"
+#include "../gbuffer.h"
+#include "../material.h"
+#include "../texture.h"
+
+constexpr size_t WIDTH = 400;
+constexpr size_t HEIGHT = 400;
+// Los dos caminos difieren en el redondeo de las derivadas (half) y del marco tangente (octaedrico)
+constexpr int MAX_CHANNEL_DIFFERENCE = 2;
+
+Uniforms modelUniforms(float angle) {
+    Uniforms uniforms;
+    uniforms.model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    uniforms.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    uniforms.projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+    // Mismo viewport que createViewportMatrix() con depth float, fila 0 arriba
+    uniforms.viewport = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, HEIGHT - 1.0f, 0.0f))
+        * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f))
+        * glm::scale(glm::mat4(1.0f), glm::vec3(WIDTH / 2.0f, HEIGHT / 2.0f, 0.5f))
+        * glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+    return uniforms;
+}
+
+// Setups y sus TriangleSurface, con el mismo indice como en FrameGeometry
+struct Triangles {
+    std::vector<TriangleSetup> setups;
+    std::vector<TriangleSurface> surfaces;
+};
+
+// Lo que buildGeometry() hace con un modelo: vertex shader y setup de cada triangulo
+Triangles setupMesh(const MeshLevel& level, const Material& material, const Uniforms& uniforms) {
+    VertexTransform transform = vertexTransform(uniforms);
+    uint8_t varyings = shaderVaryings(material.shader) | GBUFFER_VARYINGS;
+    Triangles triangles;
+    for (size_t i = 0; i < level.triangleCount(); ++i) {
+        Vertex vertices[3];
+        for (size_t v = 0; v < 3; ++v) {
+            vertices[v] = vertexShader(meshVertex(level, 3 * i + v, tangentFrame(material)), transform);
+        }
+        TriangleSetup t;
+        TriangleSurface surface;
+        if (setupTriangle(vertices[0], vertices[1], vertices[2], 0, varyings, WIDTH, HEIGHT, t, &surface)) {
+            triangles.setups.push_back(t);
+            triangles.surfaces.push_back(surface);
+        }
+    }
+    return triangles;
+}
+
+void renderForward(RenderTarget& target, const Triangles& triangles, const Material& material) {
+    using Traits = ShaderTraits<TEXTURA_NORMALES>;
+    clearFramebuffer(target);
+    TileRect rect{0, 0, WIDTH, HEIGHT};
+    for (size_t i = 0; i < triangles.setups.size(); ++i) {
+        triangle<Traits::varyings>(triangles.setups[i], &triangles.surfaces[i], rect, [&](const RasterFragment<Traits::varyings>& rasterized) {
+            if (encodeDepth(rasterized.z) >= target.depth[rasterized.y * target.width + rasterized.x]) {
+                return;
+            }
+            Fragment fragment = toFragment(rasterized);
+            point(target, Traits::shade(fragment, material));
+        });
+    }
+}
+
+// Como rasterizeTile() y shadeTile() en main.cpp, sin shading de resolucion variable
+void renderDeferred(RenderTarget& target, const Triangles& triangles, const Material& material) {
+    constexpr uint8_t NormalMapped = GBUFFER_VARYINGS | VARYING_TEX | VARYING_TANGENT;
+    clearFramebuffer(target);
+    clearGBuffer(target);
+    ensureGBufferSurfaces(target);
+    TileRect rect{0, 0, WIDTH, HEIGHT};
+    for (size_t i = 0; i < triangles.setups.size(); ++i) {
+        triangle<NormalMapped>(triangles.setups[i], &triangles.surfaces[i], rect, [&](const RasterFragment<NormalMapped>& fragment) {
+            writeGBuffer(target, fragment, static_cast<uint8_t>(material.shader), 0);
+        });
+    }
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        for (size_t x = 0; x < WIDTH; ++x) {
+            if (target.gbuffer[y * WIDTH + x].material == GBUFFER_EMPTY) {
+                continue;
+            }
+            Fragment fragment = readGBuffer(target, static_cast<uint16_t>(x), static_cast<uint16_t>(y));
+            target.color[y * WIDTH + x] = texturaNormales(fragment, material).color.toARGB();
+            target.colorDirty[tileIndex(target, x, y)] = 1;
+        }
+    }
+}
+
+// Pixeles con un canal que difiere en mas de MAX_CHANNEL_DIFFERENCE
+size_t differingPixels(const RenderTarget& a, const RenderTarget& b) {
+    size_t differing = 0;
+    for (size_t i = 0; i < WIDTH * HEIGHT; ++i) {
+        for (int shift = 0; shift < 24; shift += 8) {
+            int difference = std::abs(static_cast<int>((a.color[i] >> shift) & 0xFF) - static_cast<int>((b.color[i] >> shift) & 0xFF));
+            if (difference > MAX_CHANNEL_DIFFERENCE) {
+                differing++;
+                break;
+            }
+        }
+    }
+    return differing;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::printf("usage: deferred_test <models directory>\n");
+        return 2;
+    }
+    std::string models = argv[1];
+    auto mesh = loadMesh((models + "/diablo3.obj").c_str());
+    auto texture = loadTexture((models + "/diablo3.png").c_str());
+    auto tangentMap = loadTexture((models + "/diablo3_nm.png").c_str());
+    auto objectMap = loadTexture((models + "/diablo3_nm_world.png").c_str());
+    if (!mesh || !texture || !tangentMap || !objectMap) {
+        std::printf("deferred_test: could not load the diablo3 assets from %s\n", models.c_str());
+        return 2;
+    }
+
+    struct Case {
+        const char* name;
+        Material material;
+    };
+    Case cases[] = {
+        {"tangent-space map", texturaNormalesMaterial(texture, tangentMap, NORMAL_MAP_TANGENT)},
+        {"object-space map", texturaNormalesMaterial(texture, objectMap, NORMAL_MAP_OBJECT)},
+    };
+
+    RenderTarget forward(WIDTH, HEIGHT);
+    RenderTarget deferred(WIDTH, HEIGHT);
+    int failures = 0;
+    for (const Case& c : cases) {
+        // De frente, de costado y de espaldas, y el LOD mas simple: aristas y costuras de la uv
+        // en todas las orientaciones
+        for (size_t level : {size_t(0), mesh->levels.size() - 1}) {
+            for (float angle : {0.0f, 90.0f, 180.0f, 270.0f}) {
+                Triangles triangles = setupMesh(mesh->levels[level], c.material, modelUniforms(angle));
+                renderForward(forward, triangles, c.material);
+                renderDeferred(deferred, triangles, c.material);
+                size_t differing = differingPixels(forward, deferred);
+                if (differing > 0) {
+                    std::printf("%s, level %zu, %.0f degrees: %zu pixels differ between forward and deferred\n",
+                                c.name, level, angle, differing);
+                    failures++;
+                }
+            }
+        }
+    }
+    if (failures == 0) {
+        std::printf("deferred_test: ok\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Archivos PNG y TGA armados a mano que el decodificador tiene que aceptar o rechazar sin leer fuera
+// de sus buffers ni reservar lo que pide una cabecera corrupta
+#include <cstdio>
+#include "../image.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+void appendBigEndian(std::vector<uint8_t>& bytes, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        bytes.push_back(uint8_t(value >> shift));
+    }
+}
+
+void appendChunk(std::vector<uint8_t>& file, const char* type, const std::vector<uint8_t>& data) {
+    appendBigEndian(file, uint32_t(data.size()));
+    file.insert(file.end(), type, type + 4);
+    file.insert(file.end(), data.begin(), data.end());
+    file.insert(file.end(), 4, 0); // el decodificador no revisa el CRC
+}
+
+// PNG con la cabecera dada y `idat` como datos comprimidos
+std::vector<uint8_t> makePNG(uint8_t bitDepth, uint8_t colorType, const std::vector<uint8_t>& idat,
+                             uint32_t width = 1, uint32_t height = 1) {
+    std::vector<uint8_t> file = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {bitDepth, colorType, 0, 0, 0});
+    appendChunk(file, "IHDR", header);
+    if (colorType == 3) {
+        appendChunk(file, "PLTE", {255, 0, 0});
+    }
+    appendChunk(file, "IDAT", idat);
+    appendChunk(file, "IEND", {});
+    return file;
+}
+
+// Cabecera TGA sin comprimir de width x height a 24 bits, sin datos detras
+std::vector<uint8_t> makeTGAHeader(uint16_t width, uint16_t height) {
+    return {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, uint8_t(width), uint8_t(width >> 8), uint8_t(height), uint8_t(height >> 8), 24, 0};
+}
+
+// zlib de la fila {filtro 0, 200}
+const std::vector<uint8_t> ONE_PIXEL = {0x78, 0xDA, 0x63, 0x38, 0x01, 0x00, 0x00, 0xCA, 0x00, 0xC9};
+// zlib de 4096 ceros: casi todo back-references, mucho mas de lo que cabe en una imagen de 1x1
+const std::vector<uint8_t> ZEROS_4096 = {0x78, 0xDA, 0xED, 0xC1, 0x01, 0x0D, 0x00, 0x00, 0x00, 0xC2, 0xA0, 0xF7, 0x4F,
+                                         0x6D, 0x0F, 0x07, 0x14, 0x00, 0x00, 0x00, 0xF0, 0x6E, 0x10, 0x00, 0x00, 0x01};
+
+int main() {
+    Image image;
+    std::string error;
+
+    CHECK(decodePNG(makePNG(8, 0, ONE_PIXEL), image, error));
+    CHECK(image.width == 1 && image.height == 1 && image.pixels.size() == 1);
+    CHECK(!image.pixels.empty() && image.pixels[0] == packTexel(200, 200, 200, 255));
+
+    // Profundidad 0: stride 0 y division por cero al escalar el gris
+    error.clear();
+    CHECK(!decodePNG(makePNG(0, 0, ONE_PIXEL), image, error));
+    CHECK(error == "unsupported bit depth or missing palette");
+    CHECK(!decodePNG(makePNG(0, 3, ONE_PIXEL), image, error));
+
+    // Profundidades que no existen para el tipo de color
+    CHECK(!decodePNG(makePNG(16, 3, ONE_PIXEL), image, error));
+    CHECK(!decodePNG(makePNG(4, 2, ONE_PIXEL), image, error));
+    CHECK(!decodePNG(makePNG(3, 0, ONE_PIXEL), image, error));
+
+    // El inflate se corta en height * (stride + 1) bytes
+    error.clear();
+    CHECK(!decodePNG(makePNG(8, 0, ZEROS_4096), image, error));
+    CHECK(error == "corrupt image data");
+
+    // Cabeceras que piden mucho mas de lo que trae el archivo: se rechazan antes de reservar nada
+    error.clear();
+    CHECK(!decodePNG(makePNG(16, 6, ONE_PIXEL, 16384, 16384), image, error));
+    CHECK(error == "image too large");
+    error.clear();
+    CHECK(!decodePNG(makePNG(16, 6, ONE_PIXEL, 8192, 8192), image, error));
+    CHECK(error == "truncated image data");
+    error.clear();
+    CHECK(!decodeTGA(makeTGAHeader(8192, 8192), image, error));
+    CHECK(error == "truncated TGA data");
+    std::vector<uint8_t> rle = makeTGAHeader(8192, 8192);
+    rle[2] = 10;
+    rle.insert(rle.end(), {0xFF, 1, 2, 3});
+    error.clear();
+    CHECK(!decodeTGA(rle, image, error));
+    CHECK(error == "truncated TGA data");
+
+    if (failures == 0) {
+        std::printf("image_test: ok\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "image.h"
+
+// Orden de los texels en memoria. Fila por fila, un triangulo girado (o una uv como la de
+// diablo3) recorre la textura en columnas y cada texel cae en otra linea de cache; en
+// bloques o en orden Z los vecinos en 2D quedan cerca tambien en memoria.
+enum TextureLayout {
+    TEXTURE_LINEAR, // fila por fila
+    TEXTURE_TILED,  // bloques de 4x4 texels (64 bytes, una linea de cache), los bloques fila por fila
+    TEXTURE_MORTON, // orden Z (Morton) en todo el nivel
+};
+
+// Lado de un bloque de TEXTURE_TILED
+constexpr size_t TEXTURE_TILE = 4;
+
+// Un nivel del mip chain, en el mismo ARGB8888 que Image. Con TILED y MORTON el arreglo
+// tiene relleno hasta bloques enteros o potencias de 2; el relleno nunca se lee.
+struct TextureLevel {
+    size_t width = 0;
+    size_t height = 0;
+    size_t tilesX = 0;       // TILED: bloques por fila
+    uint32_t mortonBits = 0; // MORTON: bits que se intercalan, log2 del lado menor con relleno
+    std::vector<Uint32> texels;
+};
+
+// Textura inmutable con su mip chain: levels[0] es la imagen y cada nivel siguiente la
+// mitad del anterior hasta 1x1. Los modelos la comparten por shared_ptr<const Texture>
+// igual que los meshes. Se muestrea con repeat en u y v, y v = 0 es la fila de abajo,
+// como en los vt de un OBJ.
+struct Texture {
+    TextureLayout layout = TEXTURE_LINEAR;
+    std::vector<TextureLevel> levels;
+};
+
+// Separa los 16 bits bajos de v con un cero entre cada uno
+uint32_t spreadBits(uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+size_t nextPowerOfTwo(size_t v) {
+    size_t p = 1;
+    while (p < v) {
+        p *= 2;
+    }
+    return p;
+}
+
+// En los tres layouts el indice del texel (x, y) es columnOffset(x) + rowOffset(y): el
+// sampler calcula dos columnas y dos filas y no cuatro indices enteros
+template <TextureLayout Layout>
+size_t columnOffset(const TextureLevel& level, size_t x) {
+    if constexpr (Layout == TEXTURE_LINEAR) {
+        return x;
+    } else if constexpr (Layout == TEXTURE_TILED) {
+        return (x / TEXTURE_TILE) * TEXTURE_TILE * TEXTURE_TILE + x % TEXTURE_TILE;
+    } else {
+        // Los bits bajos de x van a las posiciones pares; si el nivel es mas ancho que alto,
+        // lo que sobra de x va arriba de todo
+        uint32_t bits = level.mortonBits;
+        size_t low = spreadBits(static_cast<uint32_t>(x & ((size_t(1) << bits) - 1)));
+        return ((x >> bits) << (2 * bits)) | low;
+    }
+}
+
+template <TextureLayout Layout>
+size_t rowOffset(const TextureLevel& level, size_t y) {
+    if constexpr (Layout == TEXTURE_LINEAR) {
+        return y * level.width;
+    } else if constexpr (Layout == TEXTURE_TILED) {
+        return (y / TEXTURE_TILE) * level.tilesX * TEXTURE_TILE * TEXTURE_TILE + (y % TEXTURE_TILE) * TEXTURE_TILE;
+    } else {
+        uint32_t bits = level.mortonBits;
+        size_t low = spreadBits(static_cast<uint32_t>(y & ((size_t(1) << bits) - 1))) << 1;
+        return ((y >> bits) << (2 * bits)) | low;
+    }
+}
+
+// Reordena un nivel fila por fila al layout pedido
+void swizzleLevel(TextureLevel& level, TextureLayout layout) {
+    if (layout == TEXTURE_LINEAR) {
+        return;
+    }
+    std::vector<Uint32> linear = std::move(level.texels);
+    if (layout == TEXTURE_TILED) {
+        level.tilesX = (level.width + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        size_t tilesY = (level.height + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        level.texels.assign(level.tilesX * tilesY * TEXTURE_TILE * TEXTURE_TILE, 0);
+    } else {
+        size_t paddedWidth = nextPowerOfTwo(level.width);
+        size_t paddedHeight = nextPowerOfTwo(level.height);
+        level.mortonBits = 0;
+        while ((size_t(1) << (level.mortonBits + 1)) <= std::min(paddedWidth, paddedHeight)) {
+            level.mortonBits++;
+        }
+        level.texels.assign(paddedWidth * paddedHeight, 0);
+    }
+    for (size_t y = 0; y < level.height; ++y) {
+        for (size_t x = 0; x < level.width; ++x) {
+            size_t index = layout == TEXTURE_TILED ? columnOffset<TEXTURE_TILED>(level, x) + rowOffset<TEXTURE_TILED>(level, y)
+                                                   : columnOffset<TEXTURE_MORTON>(level, x) + rowOffset<TEXTURE_MORTON>(level, y);
+            level.texels[index] = linear[y * level.width + x];
+        }
+    }
+}
+
+// Cada texel del nivel siguiente es el promedio de sus 2x2 (los bordes impares se repiten)
+TextureLevel downsample(const TextureLevel& source) {
+    TextureLevel level;
+    level.width = std::max<size_t>(source.width / 2, 1);
+    level.height = std::max<size_t>(source.height / 2, 1);
+    level.texels.resize(level.width * level.height);
+    for (size_t y = 0; y < level.height; ++y) {
+        size_t y0 = std::min(2 * y, source.height - 1);
+        size_t y1 = std::min(2 * y + 1, source.height - 1);
+        for (size_t x = 0; x < level.width; ++x) {
+            size_t x0 = std::min(2 * x, source.width - 1);
+            size_t x1 = std::min(2 * x + 1, source.width - 1);
+            Uint32 quad[4] = {source.texels[y0 * source.width + x0], source.texels[y0 * source.width + x1],
+                              source.texels[y1 * source.width + x0], source.texels[y1 * source.width + x1]};
+            Uint32 texel = 0;
+            for (uint32_t shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2; // redondeo
+                for (Uint32 q : quad) {
+                    sum += (q >> shift) & 0xFF;
+                }
+                texel |= (sum / 4) << shift;
+            }
+            level.texels[y * level.width + x] = texel;
+        }
+    }
+    return level;
+}
+
+// Por defecto en bloques: ver --bench-texture en el README
+Texture buildTexture(Image image, TextureLayout layout = TEXTURE_TILED) {
+    Texture texture;
+    TextureLevel& base = texture.levels.emplace_back();
+    base.width = image.width;
+    base.height = image.height;
+    base.texels = std::move(image.pixels);
+    while (texture.levels.back().width > 1 || texture.levels.back().height > 1) {
+        texture.levels.push_back(downsample(texture.levels.back()));
+    }
+    // El mip chain se arma fila por fila y recien despues se reordena
+    texture.layout = layout;
+    for (TextureLevel& level : texture.levels) {
+        swizzleLevel(level, layout);
+    }
+    return texture;
+}
+
+// Canales de 0 a 255, sin normalizar: el sampler mezcla asi y divide una sola vez
+glm::vec4 unpackTexel(Uint32 texel) {
+    return glm::vec4((texel >> 16) & 0xFF, (texel >> 8) & 0xFF, texel & 0xFF, texel >> 24);
+}
+
+// Indice con repeat; tambien para negativos. Casi siempre ya esta dentro y no hace falta dividir.
+size_t wrapTexel(int i, size_t size) {
+    int n = static_cast<int>(size);
+    if (static_cast<unsigned>(i) < size) {
+        return static_cast<size_t>(i);
+    }
+    i %= n;
+    return static_cast<size_t>(i < 0 ? i + n : i);
+}
+
+template <TextureLayout Layout>
+glm::vec4 sampleBilinear(const Texture& texture, const glm::vec2& uv, size_t levelIndex) {
+    const TextureLevel& level = texture.levels[levelIndex];
+    // Centro del texel (0, 0) en 0.5: se resta para quedar entre los cuatro vecinos
+    float x = uv.x * level.width - 0.5f;
+    float y = (1.0f - uv.y) * level.height - 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float tx = x - fx;
+    float ty = y - fy;
+    size_t x0 = wrapTexel(static_cast<int>(fx), level.width);
+    size_t y0 = wrapTexel(static_cast<int>(fy), level.height);
+    size_t x1 = x0 + 1 < level.width ? x0 + 1 : 0;
+    size_t y1 = y0 + 1 < level.height ? y0 + 1 : 0;
+    size_t column0 = columnOffset<Layout>(level, x0);
+    size_t column1 = columnOffset<Layout>(level, x1);
+    size_t row0 = rowOffset<Layout>(level, y0);
+    size_t row1 = rowOffset<Layout>(level, y1);
+    const Uint32* texels = level.texels.data();
+    glm::vec4 top = glm::mix(unpackTexel(texels[row0 + column0]), unpackTexel(texels[row0 + column1]), tx);
+    glm::vec4 bottom = glm::mix(unpackTexel(texels[row1 + column0]), unpackTexel(texels[row1 + column1]), tx);
+    return glm::mix(top, bottom, ty) * (1.0f / 255.0f);
+}
+
+// Nivel de detalle de un pixel: log2 de cuantos texels de levels[0] cubre, segun las
+// derivadas en pantalla de uv. 0 o menos es magnificacion.
+float textureLod(const Texture& texture, const glm::vec2& dx, const glm::vec2& dy) {
+    glm::vec2 size = glm::vec2(texture.levels[0].width, texture.levels[0].height);
+    float footprint = std::max(glm::dot(dx * size, dx * size), glm::dot(dy * size, dy * size));
+    return footprint > 0.0f ? 0.5f * std::log2(footprint) : 0.0f;
+}
+
+// Mezcla lineal de los dos niveles que rodean al LOD del pixel: una textura lejana se
+// lee de un nivel chico, que cabe en cache, en vez de saltar por toda la imagen
+template <TextureLayout Layout>
+glm::vec4 sampleTrilinear(const Texture& texture, const glm::vec2& uv, const glm::vec2& dx, const glm::vec2& dy) {
+    float lod = std::clamp(textureLod(texture, dx, dy), 0.0f, static_cast<float>(texture.levels.size() - 1));
+    size_t level = static_cast<size_t>(lod);
+    float t = lod - level;
+    glm::vec4 color = sampleBilinear<Layout>(texture, uv, level);
+    if (t > 0.0f && level + 1 < texture.levels.size()) {
+        color = glm::mix(color, sampleBilinear<Layout>(texture, uv, level + 1), t);
+    }
+    return color;
+}
+
+glm::vec4 sampleTrilinear(const Texture& texture, const glm::vec2& uv, const glm::vec2& dx, const glm::vec2& dy) {
+    switch (texture.layout) {
+        case TEXTURE_TILED:
+            return sampleTrilinear<TEXTURE_TILED>(texture, uv, dx, dy);
+        case TEXTURE_MORTON:
+            return sampleTrilinear<TEXTURE_MORTON>(texture, uv, dx, dy);
+        case TEXTURE_LINEAR:
+            break;
+    }
+    return sampleTrilinear<TEXTURE_LINEAR>(texture, uv, dx, dy);
+}
+
+// nullptr si no se pudo leer o decodificar; el motivo va a std::cerr
+std::shared_ptr<const Texture> loadTexture(const char* path) {
+    Image image;
+    std::string error;
+    if (!loadImage(path, image, error)) {
+        std::cerr << "Error: Failed to load texture " << path << ": " << error << std::endl;
+        return nullptr;
+    }
+    return std::make_shared<const Texture>(buildTexture(std::move(image)));
+}
@@ -1,5 +1,7 @@
 #pragma once
-#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
 #include "glm/glm.hpp"
 #include "line.h"
 #include "framebuffer.h"
@@ -7,79 +9,270 @@
 
 glm::vec3 L = glm::vec3(0.0f, 0.0f, 1.0f);
 
-std::pair<float, float> barycentricCoordinates(const glm::ivec2& P, const glm::vec3& A, const glm::vec3& B, const glm::vec3& C) {
-    glm::vec3 bary = glm::cross(
-        glm::vec3(C.x - A.x, B.x - A.x, A.x - P.x),
-        glm::vec3(C.y - A.y, B.y - A.y, A.y - P.y)
-    );
+// Valor lineal en pantalla: dx * x + dy * y + c, con x, y relativos a la esquina del bounding box
+struct Plane {
+  float dx;
+  float dy;
+  float c;
 
-    if (abs(bary.z) < 1) {
-        return std::make_pair(-1, -1);
-    }
+  float at(float x, float y) const {
+    return dx * x + dy * y + c;
+  }
+};
+
+struct Plane2 {
+  glm::vec2 dx;
+  glm::vec2 dy;
+  glm::vec2 c;
+
+  glm::vec2 at(float x, float y) const {
+    return dx * x + dy * y + c;
+  }
+};
+
+struct Plane3 {
+  glm::vec3 dx;
+  glm::vec3 dy;
+  glm::vec3 c;
+
+  glm::vec3 at(float x, float y) const {
+    return dx * x + dy * y + c;
+  }
+};
+
+// Todo lo que es constante por triangulo, calculado una vez en la etapa de geometria.
+// El rasterizador solo evalua planos, no vuelve a mirar los vertices.
+// z/w es lineal en pantalla; los atributos no, asi que se guardan como attr/w junto con
+// el plano de 1/w y se dividen en cada pixel (interpolacion con correccion de perspectiva).
+struct TriangleSetup {
+  // Coordenadas baricentricas de A, B y C; el pixel esta dentro si las tres son positivas
+  Plane edges[3];
+  Plane z;
+  Plane invW;
+  Plane3 normal;      // sin dividir: normalize() no cambia con la escala
+  Plane3 worldPos;    // solo si se pidio VARYING_WORLD_POS en setupTriangle()
+  Plane3 originalPos; // solo si se pidio VARYING_ORIGINAL_POS
+  // Bounding box en pixeles, inclusiva y ya recortada al target
+  int32_t minX;
+  int32_t minY;
+  int32_t maxX;
+  int32_t maxY;
+  uint16_t model;
+};
+
+// Los planos de los shaders con textura o normal map, aparte para que el TriangleSetup de los
+// demas no los arrastre por el binning y los tiles. Van en un arreglo paralelo a los setups, con
+// el mismo indice, que solo existe si algun modelo del frame pide VARYING_TEX o VARYING_TANGENT.
+struct TriangleSurface {
+  Plane2 tex;       // solo si se pidio VARYING_TEX
+  Plane3 tangent;   // solo si se pidio VARYING_TANGENT; sin dividir, como normal
+  Plane3 bitangent;
+};
 
-    return std::make_pair(
-        bary.y / bary.z,
-        bary.x / bary.z
-    );    
+Plane scalarPlane(float a, float b, float c, const TriangleSetup& t) {
+  return Plane{
+    a * t.edges[0].dx + b * t.edges[1].dx + c * t.edges[2].dx,
+    a * t.edges[0].dy + b * t.edges[1].dy + c * t.edges[2].dy,
+    a * t.edges[0].c + b * t.edges[1].c + c * t.edges[2].c
+  };
 }
 
-std::vector<Fragment> triangle(const Vertex& a, const Vertex& b, const Vertex& c) {
-  std::vector<Fragment> fragments;
+Plane3 attributePlane(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const TriangleSetup& t) {
+  return Plane3{
+    a * t.edges[0].dx + b * t.edges[1].dx + c * t.edges[2].dx,
+    a * t.edges[0].dy + b * t.edges[1].dy + c * t.edges[2].dy,
+    a * t.edges[0].c + b * t.edges[1].c + c * t.edges[2].c
+  };
+}
+
+Plane2 texPlane(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c, const TriangleSetup& t) {
+  return Plane2{
+    a * t.edges[0].dx + b * t.edges[1].dx + c * t.edges[2].dx,
+    a * t.edges[0].dy + b * t.edges[1].dy + c * t.edges[2].dy,
+    a * t.edges[0].c + b * t.edges[1].c + c * t.edges[2].c
+  };
+}
+
+// Arma el setup de un triangulo en espacio de pantalla. Falso si no cubre ningun pixel de un
+// target de width x height: fuera de la pantalla, o tan fino que el rasterizador no lo muestrea.
+// `surface` solo se usa (y no puede ser nullptr) si varyings pide VARYING_TEX o VARYING_TANGENT.
+bool setupTriangle(const Vertex& a, const Vertex& b, const Vertex& c, uint16_t model, uint8_t varyings,
+                   size_t width, size_t height, TriangleSetup& t, TriangleSurface* surface = nullptr) {
   glm::vec3 A = a.position;
   glm::vec3 B = b.position;
   glm::vec3 C = c.position;
 
+  float area = (C.x - A.x) * (B.y - A.y) - (B.x - A.x) * (C.y - A.y);
+  if (!(std::abs(area) >= 1.0f)) {
+    return false;
+  }
+
   float minX = std::min(std::min(A.x, B.x), C.x);
   float minY = std::min(std::min(A.y, B.y), C.y);
   float maxX = std::max(std::max(A.x, B.x), C.x);
   float maxY = std::max(std::max(A.y, B.y), C.y);
+  // Primero se recorta en float, asi los vertices fuera de pantalla (o no finitos) no desbordan el cast a int
+  float x0 = std::max(0.0f, std::ceil(minX));
+  float y0 = std::max(0.0f, std::ceil(minY));
+  float x1 = std::min(width - 1.0f, std::floor(maxX));
+  float y1 = std::min(height - 1.0f, std::floor(maxY));
+  if (!(x0 <= x1 && y0 <= y1)) {
+    return false;
+  }
+  t.minX = static_cast<int32_t>(x0);
+  t.minY = static_cast<int32_t>(y0);
+  t.maxX = static_cast<int32_t>(x1);
+  t.maxY = static_cast<int32_t>(y1);
+  t.model = model;
+
+  // Peso de C (u) y de B (v), divididos por el area con signo. El origen de los planos
+  // es la esquina del bounding box para no perder precision lejos del (0, 0) de la pantalla.
+  float u0 = ((B.x - A.x) * (A.y - y0) - (A.x - x0) * (B.y - A.y)) / area;
+  float v0 = ((A.x - x0) * (C.y - A.y) - (C.x - A.x) * (A.y - y0)) / area;
+  Plane u{(B.y - A.y) / area, -(B.x - A.x) / area, u0};
+  Plane v{-(C.y - A.y) / area, (C.x - A.x) / area, v0};
+  t.edges[0] = Plane{-u.dx - v.dx, -u.dy - v.dy, 1.0f - u.c - v.c};
+  t.edges[1] = v;
+  t.edges[2] = u;
+
+  t.z = scalarPlane(A.z, B.z, C.z, t);
+  t.invW = scalarPlane(a.invW, b.invW, c.invW, t);
+  t.normal = attributePlane(a.normal * a.invW, b.normal * b.invW, c.normal * c.invW, t);
+  if (varyings & VARYING_WORLD_POS) {
+    t.worldPos = attributePlane(a.worldPos * a.invW, b.worldPos * b.invW, c.worldPos * c.invW, t);
+  }
+  if (varyings & VARYING_ORIGINAL_POS) {
+    t.originalPos = attributePlane(a.originalPos * a.invW, b.originalPos * b.invW, c.originalPos * c.invW, t);
+  }
+  if (varyings & VARYING_TEX) {
+    surface->tex = texPlane(glm::vec2(a.tex) * a.invW, glm::vec2(b.tex) * b.invW, glm::vec2(c.tex) * c.invW, t);
+  }
+  if (varyings & VARYING_TANGENT) {
+    surface->tangent = attributePlane(a.tangent * a.invW, b.tangent * b.invW, c.tangent * c.invW, t);
+    surface->bitangent = attributePlane(a.bitangent * a.invW, b.bitangent * b.invW, c.bitangent * c.invW, t);
+  }
+  return true;
+}
+
+// Campo de un varying que no se pidio; con [[no_unique_address]] no ocupa espacio
+template <int N>
+struct NoVarying {};
+
+template <bool Present, int N, typename T = glm::vec3>
+using VaryingField = std::conditional_t<Present, T, NoVarying<N>>;
+
+// Fragmento que sale del rasterizador: solo guarda los varyings de `Varyings`.
+// Con solo originalPos son 24 bytes contra los 52 del Fragment completo.
+template <uint8_t Varyings>
+struct RasterFragment {
+  static constexpr bool hasWorldPos = (Varyings & VARYING_WORLD_POS) != 0;
+  static constexpr bool hasOriginalPos = (Varyings & VARYING_ORIGINAL_POS) != 0;
+  static constexpr bool hasNormal = (Varyings & VARYING_NORMAL) != 0;
+  static constexpr bool hasTex = (Varyings & VARYING_TEX) != 0;
+  static constexpr bool hasTangent = (Varyings & VARYING_TANGENT) != 0;
+
+  uint16_t x;
+  uint16_t y;
+  float z;
+  float intensity;
+  [[no_unique_address]] VaryingField<hasWorldPos, 0> worldPos;
+  [[no_unique_address]] VaryingField<hasOriginalPos, 1> originalPos;
+  [[no_unique_address]] VaryingField<hasNormal, 2> normal;
+  [[no_unique_address]] VaryingField<hasTex, 3, glm::vec2> tex;
+  [[no_unique_address]] VaryingField<hasTex, 4, glm::vec2> texDx;
+  [[no_unique_address]] VaryingField<hasTex, 5, glm::vec2> texDy;
+  [[no_unique_address]] VaryingField<hasTangent, 6> tangent;
+  [[no_unique_address]] VaryingField<hasTangent, 7> bitangent;
+};
+
+// El Fragment que recibe un shader; los campos que no se interpolaron quedan en cero
+template <uint8_t Varyings>
+Fragment toFragment(const RasterFragment<Varyings>& f) {
+  Fragment fragment{f.x, f.y, f.z, Color(255, 255, 255), f.intensity, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f),
+                    glm::vec2(0.0f), glm::vec2(0.0f), glm::vec2(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)};
+  if constexpr (RasterFragment<Varyings>::hasWorldPos) {
+    fragment.worldPos = f.worldPos;
+  }
+  if constexpr (RasterFragment<Varyings>::hasOriginalPos) {
+    fragment.originalPos = f.originalPos;
+  }
+  if constexpr (RasterFragment<Varyings>::hasNormal) {
+    fragment.normal = f.normal;
+  }
+  if constexpr (RasterFragment<Varyings>::hasTex) {
+    fragment.tex = f.tex;
+    fragment.texDx = f.texDx;
+    fragment.texDy = f.texDy;
+  }
+  if constexpr (RasterFragment<Varyings>::hasTangent) {
+    fragment.tangent = f.tangent;
+    fragment.bitangent = f.bitangent;
+  }
+  return fragment;
+}
+
+// Solo genera los pixeles dentro de `rect`, asi cada tile se rasteriza por separado. Cada
+// fragmento va directo a emit(const RasterFragment<Varyings>&), que queda inlineado en el loop
+// de pixeles. `t` (y `surface`, con VARYING_TEX o VARYING_TANGENT) tiene que tener al menos los
+// planos que pide `Varyings`.
+template <uint8_t Varyings, typename Emit>
+void triangle(const TriangleSetup& t, const TriangleSurface* surface, const TileRect& rect, const Emit& emit) {
+  using Output = RasterFragment<Varyings>;
+  int startX = std::max(t.minX, static_cast<int32_t>(rect.x0));
+  int startY = std::max(t.minY, static_cast<int32_t>(rect.y0));
+  int endX = std::min(t.maxX, static_cast<int32_t>(rect.x1) - 1);
+  int endY = std::min(t.maxY, static_cast<int32_t>(rect.y1) - 1);
+  float epsilon = 1e-10;
 
   // Iterate over each point in the bounding box
-  for (int y = static_cast<int>(std::ceil(minY)); y <= static_cast<int>(std::floor(maxY)); ++y) {
-    for (int x = static_cast<int>(std::ceil(minX)); x <= static_cast<int>(std::floor(maxX)); ++x) {
-      if (x < 0 || y < 0 || y > SCREEN_HEIGHT || x > SCREEN_WIDTH)
-        continue;
-        
-      glm::ivec2 P(x, y);
-      auto barycentric = barycentricCoordinates(P, A, B, C);
-      float w = 1 - barycentric.first - barycentric.second;
-      float v = barycentric.first;
-      float u = barycentric.second;
-      float epsilon = 1e-10;
-
-      if (w < epsilon || v < epsilon || u < epsilon)
+  for (int y = startY; y <= endY; ++y) {
+    for (int x = startX; x <= endX; ++x) {
+      float px = static_cast<float>(x - t.minX);
+      float py = static_cast<float>(y - t.minY);
+      if (t.edges[0].at(px, py) < epsilon || t.edges[1].at(px, py) < epsilon || t.edges[2].at(px, py) < epsilon)
         continue;
-          
-      double z = A.z * w + B.z * v + C.z * u;
-      
-       glm::vec3 normal = glm::normalize( 
-           a.normal * w + b.normal * v + c.normal * u
-       ); 
-
-      // glm::vec3 normal = a.normal; // assume flatness
+
+      glm::vec3 normal = glm::normalize(t.normal.at(px, py));
       float intensity = glm::dot(normal, L);
-      
+
       if (intensity < 0)
         continue;
 
-      Color color = Color(255, 255, 255);
-
-      glm::vec3 worldPos = a.worldPos * w + b.worldPos * v + c.worldPos * u;
-      glm::vec3 originalPos = a.originalPos * w + b.originalPos * v + c.originalPos * u;
-
-      fragments.push_back(
-        Fragment{
-          static_cast<uint16_t>(P.x),
-          static_cast<uint16_t>(P.y),
-          z,
-          color,
-          intensity,
-          worldPos,
-          originalPos,
-          normal
+      Output fragment;
+      fragment.x = static_cast<uint16_t>(x);
+      fragment.y = static_cast<uint16_t>(y);
+      fragment.z = t.z.at(px, py);
+      fragment.intensity = intensity;
+      if constexpr (Output::hasWorldPos || Output::hasOriginalPos || Output::hasTex) {
+        float w = 1.0f / t.invW.at(px, py);
+        if constexpr (Output::hasWorldPos) {
+          fragment.worldPos = t.worldPos.at(px, py) * w;
         }
-      );
+        if constexpr (Output::hasOriginalPos) {
+          fragment.originalPos = t.originalPos.at(px, py) * w;
+        }
+        if constexpr (Output::hasTex) {
+          // uv = P / W con P = uv / w y W = 1 / w lineales en pantalla: d(uv)/dx = (dP/dx - uv dW/dx) * w
+          fragment.tex = surface->tex.at(px, py) * w;
+          fragment.texDx = (surface->tex.dx - fragment.tex * t.invW.dx) * w;
+          fragment.texDy = (surface->tex.dy - fragment.tex * t.invW.dy) * w;
+        }
+      }
+      if constexpr (Output::hasNormal) {
+        fragment.normal = normal;
+      }
+      if constexpr (Output::hasTangent) {
+        fragment.tangent = surface->tangent.at(px, py);
+        fragment.bitangent = surface->bitangent.at(px, py);
+      }
+      emit(fragment);
     }
+  }
 }
-  return fragments;
+
+// Sin TriangleSurface: para los varyings que caben en el TriangleSetup
+template <uint8_t Varyings, typename Emit>
+void triangle(const TriangleSetup& t, const TileRect& rect, const Emit& emit) {
+  static_assert(!(Varyings & (VARYING_TEX | VARYING_TANGENT)), "VARYING_TEX y VARYING_TANGENT necesitan su TriangleSurface");
+  triangle<Varyings>(t, nullptr, rect, emit);
 }